@@ -0,0 +1,8 @@
+# Writes the kernel source in INPUT to OUTPUT as a C++11 raw string literal,
+# matching the kernel_source.h generated by src/build
+file(READ "${INPUT}" KERNEL_SOURCE)
+file(WRITE "${OUTPUT}"
+     "// Generated from kernel.cl by CMake, do not edit\n"
+     "static const char* KERNEL_SOURCE = R\"KERNEL_CL(\n"
+     "${KERNEL_SOURCE}"
+     ")KERNEL_CL\";\n")
@@ -0,0 +1,397 @@
+// System Libraries
+#include <cmath>
+#include <cstring>
+#include <stdint.h>
+#include <algorithm>
+
+#include "option_spec.h"
+#include "option_batch.h"
+#include "black_scholes.h"
+#include "lattice_kernels.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BLACK_SCHOLES_X86
+#endif
+
+// Inlined into each instruction set variant of the batch kernel, which then
+// compiles its own copy
+#ifdef __GNUC__
+#define BLACK_SCHOLES_INLINE inline __attribute__((always_inline))
+#else
+#define BLACK_SCHOLES_INLINE inline
+#endif
+
+// Options per block of blackScholesPrices, whose escrowed stock prices stay
+// in the L1 cache between the two loops over the block
+#define BLACK_SCHOLES_BLOCK 256
+
+// Standard normal cumulative distribution
+static double normalCdf(double x) {
+    return 0.5 * erfc(-x / sqrt(2.0));
+}
+
+// Branch free in the type, so that loops over batches vectorize
+// stockPrice is net of the discrete dividends paid before maturity
+static inline double price(int type, double stockPrice, double strikePrice,
+                           double yearsToMaturity, double volatility,
+                           double riskFreeRate, double dividendYield) {
+    double volatilityTime = volatility * sqrt(yearsToMaturity);
+    double discount = exp(-riskFreeRate * yearsToMaturity);
+    double carry = exp(-dividendYield * yearsToMaturity);
+
+    double d1 = (log(stockPrice / strikePrice) +
+                 (riskFreeRate - dividendYield) * yearsToMaturity) /
+                volatilityTime + 0.5 * volatilityTime;
+    double d2 = d1 - volatilityTime;
+    return type * (stockPrice * carry * normalCdf(type * d1) -
+                   strikePrice * discount * normalCdf(type * d2));
+}
+
+// Stock price of optionSpec net of the discrete dividends paid before
+// maturity, the escrowed dividend model of the lattices
+static double escrowedStockPrice(const OptionSpec& optionSpec) {
+    if (optionSpec.numDividends == 0) {
+        return optionSpec.stockPrice;
+    }
+    return optionSpec.stockPrice -
+           dividendEscrow(dividendsToMaturity(optionSpec), 0);
+}
+
+double blackScholesPrice(const OptionSpec& optionSpec) {
+    return price(optionSpec.type, escrowedStockPrice(optionSpec),
+                 optionSpec.strikePrice, optionSpec.yearsToMaturity,
+                 optionSpec.volatility, optionSpec.riskFreeRate,
+                 optionSpec.dividendYield);
+}
+
+double blackScholesNodeValue(const OptionSpec& optionSpec, double stockPrice,
+                             double timeToExpiry, double exerciseStrike) {
+    double value = price(optionSpec.type, stockPrice, optionSpec.strikePrice,
+                         timeToExpiry, optionSpec.volatility,
+                         optionSpec.riskFreeRate, optionSpec.dividendYield);
+    if (optionSpec.isAmerican) {
+        value = std::max(value, optionSpec.type *
+                                (stockPrice - exerciseStrike));
+    }
+    return value;
+}
+
+/**
+ * Discrete dividends only shift the stock price, so the greeks by the
+ * escrowed stock price are those by the stock price
+ */
+OptionGreeks blackScholesGreeks(const OptionSpec& optionSpec) {
+    double stockPrice = escrowedStockPrice(optionSpec);
+    double strikePrice = optionSpec.strikePrice;
+    double yearsToMaturity = optionSpec.yearsToMaturity;
+    double riskFreeRate = optionSpec.riskFreeRate;
+    double dividendYield = optionSpec.dividendYield;
+    double volatilityTime = optionSpec.volatility * sqrt(yearsToMaturity);
+    double discount = exp(-riskFreeRate * yearsToMaturity);
+    double carry = exp(-dividendYield * yearsToMaturity);
+
+    double d1 = (log(stockPrice / strikePrice) +
+                 (riskFreeRate - dividendYield) * yearsToMaturity) /
+                volatilityTime + 0.5 * volatilityTime;
+    double d2 = d1 - volatilityTime;
+    double density = exp(-0.5 * d1 * d1) / sqrt(2 * M_PI);
+    int type = optionSpec.type;
+
+    OptionGreeks greeks;
+    greeks.price = blackScholesPrice(optionSpec);
+    greeks.delta = type * carry * normalCdf(type * d1);
+    greeks.gamma = carry * density / (stockPrice * volatilityTime);
+    greeks.theta = -stockPrice * carry * density * optionSpec.volatility /
+                   (2 * sqrt(yearsToMaturity)) -
+                   type * riskFreeRate * strikePrice * discount *
+                   normalCdf(type * d2) +
+                   type * dividendYield * stockPrice * carry *
+                   normalCdf(type * d1);
+    return greeks;
+}
+
+// NOTE(disiok): exp, log and erfc of libm are calls the vectorizer cannot
+// look into, so the AVX2 and AVX-512 batch kernels evaluate polynomials, to
+// within a few ulp of libm. Their loops have constant trip counts and are
+// unrolled so that only the loop over the options remains. Bits are
+// reinterpreted through memcpy, which compiles to register moves
+
+static BLACK_SCHOLES_INLINE uint64_t doubleBits(double x) {
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return bits;
+}
+
+static BLACK_SCHOLES_INLINE double bitsDouble(uint64_t bits) {
+    double x;
+    memcpy(&x, &bits, sizeof(x));
+    return x;
+}
+
+// Adding it to a double of magnitude below 2^51 rounds that to an integer,
+// held in the low bits of the mantissa
+static const double ROUNDING_SHIFT = 6755399441055744.0;
+static const double TWO_52 = 4503599627370496.0;
+// ln 2 split so that multiples of LN2_HIGH up to 2^11 are exact
+static const double LN2_HIGH = 6.93147180369123816490e-01;
+static const double LN2_LOW = 1.90821492927058770002e-10;
+
+/**
+ * exp(x) by reduction to r = x - k ln 2 with |r| <= ln 2 / 2, a degree 13
+ * Taylor polynomial of r, and the exponent bits of 2^k. x is clamped to
+ * [-708, 709] so that 2^k stays normal, which only matters where exp()
+ * underflows or overflows anyway
+ */
+static BLACK_SCHOLES_INLINE double polyExp(double x) {
+    static const double COEFFICIENTS[] = {
+        1.0, 1.0, 1.0 / 2, 1.0 / 6, 1.0 / 24, 1.0 / 120, 1.0 / 720,
+        1.0 / 5040, 1.0 / 40320, 1.0 / 362880, 1.0 / 3628800,
+        1.0 / 39916800, 1.0 / 479001600, 1.0 / 6227020800.0
+    };
+    x = std::min(std::max(x, -708.0), 709.0);
+    double shifted = x * M_LOG2E + ROUNDING_SHIFT;
+    double k = shifted - ROUNDING_SHIFT;
+    double r = (x - k * LN2_HIGH) - k * LN2_LOW;
+    double polynomial = COEFFICIENTS[13];
+#pragma GCC unroll 16
+    for (int i = 12; i >= 0; i --) {
+        polynomial = polynomial * r + COEFFICIENTS[i];
+    }
+    uint64_t exponent = doubleBits(shifted) - doubleBits(ROUNDING_SHIFT) +
+                        1023;
+    return polynomial * bitsDouble(exponent << 52);
+}
+
+/**
+ * log(x) of a positive normal x = m 2^e with m in [sqrt(1/2), sqrt(2)), by
+ * the series 2 atanh(s) of s = (m - 1) / (m + 1), |s| < 0.172
+ */
+static BLACK_SCHOLES_INLINE double polyLog(double x) {
+    uint64_t bits = doubleBits(x);
+    // Exponent field converted through the mantissa of 2^52, as 64 bit
+    // integer conversions do not vectorize without AVX-512
+    double exponent = bitsDouble((bits >> 52) | doubleBits(TWO_52)) -
+                      TWO_52 - 1023;
+    double mantissa = bitsDouble((bits & 0x000FFFFFFFFFFFFFULL) |
+                                 doubleBits(1.0));
+    double halve = mantissa > M_SQRT2 ? 1.0 : 0.0;
+    mantissa *= 1 - 0.5 * halve;
+    exponent += halve;
+
+    double s = (mantissa - 1) / (mantissa + 1);
+    double s2 = s * s;
+    double series = 1.0 / 21;
+#pragma GCC unroll 16
+    for (int k = 9; k >= 0; k --) {
+        series = series * s2 + 1.0 / (2 * k + 1);
+    }
+    return exponent * LN2_HIGH + (exponent * LN2_LOW + 2 * s * series);
+}
+
+/**
+ * Standard normal cumulative distribution through the Chebyshev expansion
+ * of erfc of Numerical Recipes, erfc(z) = t exp(-z^2 + P(4t - 2)) with
+ * t = 2 / (2 + z), to about 1e-16 relative for z >= 0 and by reflection
+ * for z < 0
+ */
+static BLACK_SCHOLES_INLINE double polyNormalCdf(double x) {
+    static const double COEFFICIENTS[] = {
+        -1.30265371978170941e+00, 6.41969792356490210e-01,
+        1.94764732041858360e-02, -9.56151478680863226e-03,
+        -9.46595344482036916e-04, 3.66839497852761447e-04,
+        4.25233248069077689e-05, -2.02785781125342418e-05,
+        -1.62429000464702561e-06, 1.30365583558052324e-06,
+        1.56264417220661419e-08, -8.52380959149265415e-08,
+        6.52905443909885149e-09, 5.05934349555146930e-09,
+        -9.91364156493033066e-10, -2.27365122293183597e-10,
+        9.64679110201552702e-11, 2.39403808303911459e-12,
+        -6.88602752649755322e-12, 8.94487927309072531e-13,
+        3.13092139934295813e-13, -1.12708223613672523e-13,
+        3.81090525518923205e-16, 7.10609761360923712e-15,
+        -1.52302820145710434e-15, -9.45749457129123340e-17,
+        1.21023718922427899e-16, -2.81666308774717710e-17
+    };
+    const int numCoefficients = 28;
+    double z = std::fabs(x) * M_SQRT1_2;
+    double t = 2 / (2 + z);
+    double ty = 4 * t - 2;
+    double d = 0;
+    double dd = 0;
+#pragma GCC unroll 32
+    for (int j = numCoefficients - 1; j > 0; j --) {
+        double previous = d;
+        d = ty * d - dd + COEFFICIENTS[j];
+        dd = previous;
+    }
+    // Lower tail of |x|, half of erfc(z)
+    double tail = 0.5 * t * polyExp(-z * z + 0.5 * (COEFFICIENTS[0] +
+                                                    ty * d) - dd);
+    return x < 0 ? tail : 1 - tail;
+}
+
+/**
+ * Prices numOptions options from their columns, with stockPrice already
+ * net of the discrete dividends. Straight line code without calls, which
+ * the compiler vectorizes for the instruction set of each variant below
+ */
+static BLACK_SCHOLES_INLINE void priceColumns(const int* type,
+                                              const double* stockPrice,
+                                              const float* strikePrice,
+                                              const float* yearsToMaturity,
+                                              const float* volatility,
+                                              const float* riskFreeRate,
+                                              const float* dividendYield,
+                                              double* prices,
+                                              int numOptions) {
+    for (int i = 0; i < numOptions; i ++) {
+        double sign = type[i];
+        double strike = strikePrice[i];
+        double maturity = yearsToMaturity[i];
+        double rate = riskFreeRate[i];
+        double yield = dividendYield[i];
+        double volatilityTime = volatility[i] * sqrt(maturity);
+        double discount = polyExp(-rate * maturity);
+        double carry = polyExp(-yield * maturity);
+
+        double d1 = (polyLog(stockPrice[i] / strike) +
+                     (rate - yield) * maturity) / volatilityTime +
+                    0.5 * volatilityTime;
+        double d2 = d1 - volatilityTime;
+        prices[i] = sign * (stockPrice[i] * carry * polyNormalCdf(sign * d1) -
+                            strike * discount * polyNormalCdf(sign * d2));
+    }
+}
+
+// Without wide vectors the polynomials cost more than the calls into libm
+static void priceColumnsScalar(const int* type, const double* stockPrice,
+                               const float* strikePrice,
+                               const float* yearsToMaturity,
+                               const float* volatility,
+                               const float* riskFreeRate,
+                               const float* dividendYield,
+                               double* prices, int numOptions) {
+    for (int i = 0; i < numOptions; i ++) {
+        prices[i] = price(type[i], stockPrice[i], strikePrice[i],
+                          yearsToMaturity[i], volatility[i], riskFreeRate[i],
+                          dividendYield[i]);
+    }
+}
+
+#ifdef BLACK_SCHOLES_X86
+__attribute__((target("avx2,fma")))
+static void priceColumnsAVX2(const int* type, const double* stockPrice,
+                             const float* strikePrice,
+                             const float* yearsToMaturity,
+                             const float* volatility,
+                             const float* riskFreeRate,
+                             const float* dividendYield,
+                             double* prices, int numOptions) {
+    priceColumns(type, stockPrice, strikePrice, yearsToMaturity, volatility,
+                 riskFreeRate, dividendYield, prices, numOptions);
+}
+
+__attribute__((target("avx512f")))
+static void priceColumnsAVX512(const int* type, const double* stockPrice,
+                               const float* strikePrice,
+                               const float* yearsToMaturity,
+                               const float* volatility,
+                               const float* riskFreeRate,
+                               const float* dividendYield,
+                               double* prices, int numOptions) {
+    priceColumns(type, stockPrice, strikePrice, yearsToMaturity, volatility,
+                 riskFreeRate, dividendYield, prices, numOptions);
+}
+#endif
+
+typedef void (*PriceColumnsFn)(const int*, const double*, const float*,
+                               const float*, const float*, const float*,
+                               const float*, double*, int);
+
+static PriceColumnsFn selectPriceColumns(SimdLevel level) {
+#ifdef BLACK_SCHOLES_X86
+    if (level == SIMD_AVX512) {
+        return priceColumnsAVX512;
+    }
+    if (level == SIMD_AVX2) {
+        return priceColumnsAVX2;
+    }
+#endif
+    return priceColumnsScalar;
+}
+
+/**
+ * Stock prices of options first to first + numOptions - 1 net of their
+ * discrete dividends up to maturity, read straight off the dividend
+ * columns as dividendEscrow(dividendsToMaturity(optionSpec), 0) would
+ */
+static void escrowedStockPrices(const OptionBatch& optionBatch, size_t first,
+                                int numOptions, double* stockPrice) {
+    for (int j = 0; j < numOptions; j ++) {
+        size_t i = first + j;
+        stockPrice[j] = optionBatch.stockPrice[i];
+        int numDividends = std::min(optionBatch.numDividends[i],
+                                    MAX_DIVIDENDS);
+        const float* dividendTimes =
+            &optionBatch.dividendTimes[i * MAX_DIVIDENDS];
+        const float* dividendAmounts =
+            &optionBatch.dividendAmounts[i * MAX_DIVIDENDS];
+        double escrow = 0;
+        for (int k = 0; k < numDividends; k ++) {
+            double dividendTime = dividendTimes[k];
+            if (dividendTime > 0 &&
+                dividendTime <= optionBatch.yearsToMaturity[i]) {
+                escrow += dividendAmounts[k] *
+                          exp(-optionBatch.riskFreeRate[i] * dividendTime);
+            }
+        }
+        stockPrice[j] -= escrow;
+    }
+}
+
+/**
+ * A single pass over the aligned columns in blocks, each block escrowing
+ * the discrete dividends of its options and then pricing them all with the
+ * formula of the instruction set simdLevel() dispatches to
+ */
+void blackScholesPrices(const OptionBatch& optionBatch, double* prices) {
+    PriceColumnsFn priceBlock = selectPriceColumns(simdLevel());
+    double stockPrice[BLACK_SCHOLES_BLOCK];
+    size_t numOptions = optionBatch.size();
+    for (size_t first = 0; first < numOptions;
+         first += BLACK_SCHOLES_BLOCK) {
+        int numBlockOptions = std::min(numOptions - first,
+                                       (size_t) BLACK_SCHOLES_BLOCK);
+        escrowedStockPrices(optionBatch, first, numBlockOptions, stockPrice);
+        priceBlock(&optionBatch.type[first], stockPrice,
+                   &optionBatch.strikePrice[first],
+                   &optionBatch.yearsToMaturity[first],
+                   &optionBatch.volatility[first],
+                   &optionBatch.riskFreeRate[first],
+                   &optionBatch.dividendYield[first], prices + first,
+                   numBlockOptions);
+    }
+}
+
+// The stock price is taken forward over the dividends to maturity, for
+// which the formula is that of an option without dividends
+double blackScholesVolatilityEstimate(const OptionSpec& optionSpec,
+                                      double marketPrice) {
+    double stockPrice = escrowedStockPrice(optionSpec) *
+        exp(-optionSpec.dividendYield * optionSpec.yearsToMaturity);
+    double discountedStrike = optionSpec.strikePrice *
+        exp(-optionSpec.riskFreeRate * optionSpec.yearsToMaturity);
+
+    // Price of the call with the same strike
+    double callPrice = marketPrice;
+    if (optionSpec.type == -1) {
+        callPrice += stockPrice - discountedStrike;
+    }
+
+    double moneyness = stockPrice - discountedStrike;
+    double centered = callPrice - 0.5 * moneyness;
+    double discriminant = std::max(
+            centered * centered - moneyness * moneyness / M_PI, 0.0);
+    double volatilityTime = sqrt(2 * M_PI) / (stockPrice + discountedStrike) *
+                            (centered + sqrt(discriminant));
+    return std::max(volatilityTime, 0.0) / sqrt(optionSpec.yearsToMaturity);
+}
@@ -0,0 +1,36 @@
+#ifndef __BLACK_SCHOLES_H__
+#define __BLACK_SCHOLES_H__
+#include "option_spec.h"
+#include "option_batch.h"
+
+// Closed form price of the European option of optionSpec, with discrete
+// dividends escrowed as on the lattices, numSteps and isAmerican are ignored
+double blackScholesPrice(const OptionSpec& optionSpec);
+
+/**
+ * Value of the option of optionSpec at a lattice node of stock price
+ * stockPrice, timeToExpiry before expiry, in closed form as the BBS method
+ * values the last time-step of a lattice. American options allow exercise
+ * at the node against exerciseStrike, the strike less the discrete
+ * dividends stockPrice is net of.
+ */
+double blackScholesNodeValue(const OptionSpec& optionSpec, double stockPrice,
+                             double timeToExpiry, double exerciseStrike);
+
+// Closed form price and greeks of the European option of optionSpec
+OptionGreeks blackScholesGreeks(const OptionSpec& optionSpec);
+
+// Closed form prices of every option of optionBatch as European options,
+// written to prices in order
+void blackScholesPrices(const OptionBatch& optionBatch, double* prices);
+
+/**
+ * Corrado-Miller estimate of the volatility at which the European option of
+ * optionSpec is worth marketPrice, puts going through put-call parity
+ *
+ * Accurate to a few percent near the money and never negative, meant as the
+ * starting point of a root finder rather than an implied volatility.
+ */
+double blackScholesVolatilityEstimate(const OptionSpec& optionSpec,
+                                      double marketPrice);
+#endif
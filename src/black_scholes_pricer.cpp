@@ -0,0 +1,23 @@
+#include <vector>
+
+#include "option_spec.h"
+#include "option_batch.h"
+#include "pricer.h"
+#include "black_scholes.h"
+
+double BlackScholesPricer::price(OptionSpec& optionSpec) {
+    return blackScholesPrice(optionSpec);
+}
+
+void BlackScholesPricer::price(const OptionBatch& optionBatch,
+                               std::vector<double>& prices) {
+    prices.resize(optionBatch.size());
+    if (optionBatch.size() > 0) {
+        blackScholesPrices(optionBatch, &prices[0]);
+    }
+}
+
+OptionGreeks BlackScholesPricer::priceWithGreeks(
+        const OptionSpec& optionSpec) {
+    return blackScholesGreeks(optionSpec);
+}
@@ -0,0 +1,40 @@
+// System Libraries
+#include <map>
+#include <vector>
+#include <mutex>
+
+// OpenCL C++ Binding
+#include "cl.hpp"
+
+#include "buffer_pool.h"
+
+// Smallest buffer handed out by the pool, in bytes
+static const size_t MIN_SIZE_CLASS = 4096;
+
+BufferPool::BufferPool(cl::Context* context): context(context) {
+}
+
+size_t BufferPool::sizeClass(size_t size) {
+    size_t sizeClass = MIN_SIZE_CLASS;
+    while (sizeClass < size) {
+        sizeClass *= 2;
+    }
+    return sizeClass;
+}
+
+cl::Buffer BufferPool::acquire(size_t size) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<cl::Buffer>& buffers = freeBuffers[sizeClass(size)];
+    if (buffers.empty()) {
+        return cl::Buffer(*context, CL_MEM_READ_WRITE, sizeClass(size));
+    }
+    cl::Buffer buffer = buffers.back();
+    buffers.pop_back();
+    return buffer;
+}
+
+void BufferPool::release(const cl::Buffer& buffer) {
+    size_t size = buffer.getInfo<CL_MEM_SIZE>();
+    std::lock_guard<std::mutex> lock(mutex);
+    freeBuffers[size].push_back(buffer);
+}
@@ -0,0 +1,33 @@
+#ifndef __BUFFER_POOL_H__
+#define __BUFFER_POOL_H__
+// System Libraries
+#include <map>
+#include <vector>
+#include <mutex>
+
+// OpenCL C++ Binding
+#include "cl.hpp"
+
+/**
+ * Pool of device buffers grouped by size class
+ *
+ * Requested sizes are rounded up to the next power of two so that pricing
+ * at similar step counts reuses the same buffers instead of allocating
+ * device memory on every call. Buffers of asynchronous calls are released
+ * from OpenCL callback threads, so the pool is thread safe.
+ */
+class BufferPool {
+public:
+    BufferPool(cl::Context* context);
+    // Returns a buffer of at least size bytes
+    cl::Buffer acquire(size_t size);
+    // Returns a buffer obtained from acquire back to the pool
+    void release(const cl::Buffer& buffer);
+private:
+    static size_t sizeClass(size_t size);
+
+    cl::Context* context;
+    std::mutex mutex;
+    std::map<size_t, std::vector<cl::Buffer> > freeBuffers;
+};
+#endif
@@ -0,0 +1,39 @@
+// System Libraries
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include "implied_volatility.h"
+
+VolatilitySearch::VolatilitySearch(double initialVolatility):
+    volatility(std::min(std::max(initialVolatility, IMPLIED_VOLATILITY_MIN),
+                        IMPLIED_VOLATILITY_MAX)),
+    low(IMPLIED_VOLATILITY_MIN), high(IMPLIED_VOLATILITY_MAX),
+    isConverged(false) {
+}
+
+void VolatilitySearch::step(double price, double vega, double marketPrice) {
+    if (price > marketPrice) {
+        high = volatility;
+    } else {
+        low = volatility;
+    }
+    double next = volatility - (price - marketPrice) / vega;
+    if (!(next > low && next < high)) {
+        next = 0.5 * (low + high);
+    }
+    isConverged = std::abs(next - volatility) < IMPLIED_VOLATILITY_TOLERANCE;
+    volatility = next;
+}
+
+double VolatilitySearch::result() const {
+    return impliedVolatilityResult(volatility);
+}
+
+double impliedVolatilityResult(double volatility) {
+    if (volatility - IMPLIED_VOLATILITY_MIN < IMPLIED_VOLATILITY_TOLERANCE ||
+        IMPLIED_VOLATILITY_MAX - volatility < IMPLIED_VOLATILITY_TOLERANCE) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    return volatility;
+}
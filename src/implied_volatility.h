@@ -0,0 +1,40 @@
+#ifndef __IMPLIED_VOLATILITY_H__
+#define __IMPLIED_VOLATILITY_H__
+#include "option_spec.h"
+
+// Bracket of volatilities searched, below the lower end the lattice
+// weights of typical trees stop being probabilities
+#define IMPLIED_VOLATILITY_MIN 0.01
+#define IMPLIED_VOLATILITY_MAX 5.0
+// Volatility step of the finite difference giving the lattice vega
+#define IMPLIED_VOLATILITY_BUMP 1e-3
+// Search stops once a step moves the volatility by less than this
+#define IMPLIED_VOLATILITY_TOLERANCE 1e-6
+#define IMPLIED_VOLATILITY_MAX_ITERATIONS 50
+
+/**
+ * Newton search for the volatility of one option, safeguarded by a bracket
+ *
+ * Option prices rise with the volatility, so every priced volatility
+ * narrows the bracket. Newton steps leaving the bracket, including those of
+ * a vanishing vega, fall back to bisection as in Brent's method. The
+ * impliedVolatility kernel runs the same iteration on the device.
+ */
+struct VolatilitySearch {
+    VolatilitySearch(double initialVolatility);
+    // Moves to the next volatility given the option price and vega at the
+    // current one
+    void step(double price, double vega, double marketPrice);
+    // Volatility found, see impliedVolatilityResult
+    double result() const;
+
+    double volatility;
+    double low;
+    double high;
+    bool isConverged;
+};
+
+// Volatility a search ended at, NaN when it ran into the bracket because no
+// volatility reproduces the market price
+double impliedVolatilityResult(double volatility);
+#endif
@@ -1,52 +1,358 @@
+// Lattice arithmetic precision, the host builds with -DREAL_IS_DOUBLE to
+// select the double variant on devices supporting cl_khr_fp64
+#ifdef REAL_IS_DOUBLE
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+typedef double real;
+#else
+typedef float real;
+#endif
+
+// Stock price at lattice node index of the given time-step
+// upPowers and downPowers hold upFactor^k and downFactor^k, so no node needs
+// a call to pow(). Single options get them generated on the host, batches
+// fill them on the device with pown() in fillPowers
+real
+stockPriceAt(
+        const real stockPrice,
+        __global const real* upPowers,
+        __global const real* downPowers,
+        const int index,
+        const int step
+        )
+{
+    return stockPrice * upPowers[index] * downPowers[step - index];
+}
+
+// Option value at lattice node, allowing early exercise for American options
+real
+exercise(
+        const real value,
+        const real stockPrice,
+        const real strikePrice,
+        const int type,
+        __global const real* upPowers,
+        __global const real* downPowers,
+        const int isAmerican,
+        const int index,
+        const int step
+        )
+{
+    if (!isAmerican) {
+        return value;
+    }
+    real nodeStockPrice = stockPriceAt(stockPrice, upPowers, downPowers,
+                                        index, step);
+    return max(value, type * (nodeStockPrice - strikePrice));
+}
+
+// Strike of early exercise at time-step step, less the present value of the
+// discrete dividends still to be paid that dividendEscrows holds for every
+// time-step, a null pointer for options without discrete dividends
+real
+exerciseStrike(
+        const real strikePrice,
+        __global const real* dividendEscrows,
+        const int step
+        )
+{
+    if (dividendEscrows == 0) {
+        return strikePrice;
+    }
+    return strikePrice - dividendEscrows[step];
+}
+
+// Standard normal cumulative distribution
+real
+normalCdf(
+        const real x
+        )
+{
+    return (real) 0.5 * erfc(-x / sqrt((real) 2));
+}
+
+// Option value at a node of the last time-step of the lattice
+// This is the payoff, or with a positive timeToExpiry (the BBS method) the
+// Black-Scholes value over the time left, allowing exercise against
+// exerciseStrike for American options
+real
+expiryValue(
+        const real stockPrice,
+        const real strikePrice,
+        const real exerciseStrike,
+        const int type,
+        const int isAmerican,
+        const real timeToExpiry,
+        const real volatility,
+        const real riskFreeRate,
+        const real dividendYield
+        )
+{
+    if (timeToExpiry <= 0) {
+        return max(type * (stockPrice - strikePrice), (real) 0);
+    }
+    real volatilityTime = volatility * sqrt(timeToExpiry);
+    real d1 = (log(stockPrice / strikePrice) +
+               (riskFreeRate - dividendYield) * timeToExpiry) /
+              volatilityTime + volatilityTime / 2;
+    real d2 = d1 - volatilityTime;
+    real value = type * (stockPrice * exp(-dividendYield * timeToExpiry) *
+                         normalCdf(type * d1) -
+                         strikePrice * exp(-riskFreeRate * timeToExpiry) *
+                         normalCdf(type * d2));
+    real payoff = type * (stockPrice - exerciseStrike);
+    return isAmerican ? max(value, payoff) : value;
+}
+
 __kernel void
 init(
-     const float stockPrice,
-     const float strikePrice,
+     const real stockPrice,
+     const real strikePrice,
      const int numSteps,
      const int type,
-     const float deltaT,
-     const float upFactor,
-     const float downFactor,
-     __global float* valueAtExpiry
+     const real deltaT,
+     __global const real* upPowers,
+     __global const real* downPowers,
+     __global real* valueAtExpiry,
+     const real timeToExpiry,
+     const real volatility,
+     const real riskFreeRate,
+     const int isAmerican,
+     const real dividendYield,
+     __global const real* dividendEscrows
      )
 {
     // ---------------------Calculate option value at expiry-------------------
     size_t id = get_global_id(0);
-    float stockPriceAtExpiry = stockPrice * pow(upFactor, id) *
-                                            pow(downFactor, numSteps - id);
-    valueAtExpiry[id] = max(type * (stockPriceAtExpiry - strikePrice), 0.0f); 
+    real stockPriceAtExpiry = stockPriceAt(stockPrice, upPowers, downPowers,
+                                            id, numSteps);
+    valueAtExpiry[id] = expiryValue(stockPriceAtExpiry, strikePrice,
+                                    exerciseStrike(strikePrice,
+                                                   dividendEscrows, numSteps),
+                                    type, isAmerican, timeToExpiry,
+                                    volatility, riskFreeRate, dividendYield);
     // printf("[init] valueAtExpiry[%d] = %f\n", id, valueAtExpiry[id]);
 }
 
 __kernel void
 group(
-        const float upWeight,
-        const float downWeight,
-        const float discountFactor,
-        __global float* optionValueIn,
-        __global float* optionValueOut,
+        const real upWeight,
+        const real downWeight,
+        const real discountFactor,
+        __global real* optionValueIn,
+        __global real* optionValueOut,
         const int currentNumLattice,
-        const int groupSize
+        const int groupSize,
+        const real stockPrice,
+        const real strikePrice,
+        const int type,
+        __global const real* upPowers,
+        __global const real* downPowers,
+        const int isAmerican,
+        __global const real* dividendEscrows
         )
 {
     int startIndex = get_global_id(0) * groupSize;
     int endIndex = min(startIndex + groupSize, currentNumLattice);
 
+    // Output lattice points belong to time-step (currentNumLattice - 1)
+    real strike = exerciseStrike(strikePrice, dividendEscrows,
+                                 currentNumLattice - 1);
     for (int i = startIndex; i < endIndex; i++) {
-        optionValueOut[i] = (downWeight * optionValueIn[i] + 
-                            upWeight * optionValueIn[i + 1])
-                            / discountFactor;
+        real value = (downWeight * optionValueIn[i] + 
+                      upWeight * optionValueIn[i + 1])
+                      / discountFactor;
+        optionValueOut[i] = exercise(value, stockPrice, strike, type,
+                                     upPowers, downPowers, isAmerican,
+                                     i, currentNumLattice - 1);
+    }
+}
+
+__kernel
+void trapezoid(
+        const real upWeight,
+        const real downWeight,
+        const real discountFactor,
+        __global const real* optionValueIn,
+        __global real* optionValueOut,
+        __local real* tempOptionValue,
+        const int currentNumLattice,
+        const int numTimeSteps,
+        const int tileSize,
+        const real stockPrice,
+        const real strikePrice,
+        const int type,
+        __global const real* upPowers,
+        __global const real* downPowers,
+        const int isAmerican,
+        __global const real* dividendEscrows
+        )
+{
+    int localId = get_local_id(0);
+    int groupSize = get_local_size(0);
+    int groupId = get_group_id(0);
+
+    // Each work group produces tileSize lattice points numTimeSteps earlier,
+    // which depend on the tile and a halo of numTimeSteps points to its right
+    int offset = tileSize * groupId;
+    int numInputs = min(tileSize + numTimeSteps, currentNumLattice - offset);
+
+    // Tile and halo are double buffered in local memory
+    __local real* tempIn = tempOptionValue;
+    __local real* tempOut = tempOptionValue + tileSize + numTimeSteps;
+    for (int i = localId; i < numInputs; i += groupSize) {
+        tempIn[i] = optionValueIn[offset + i];
+    }
+
+    // The valid region shrinks by one point per time-step, leaving a
+    // trapezoid that ends in the tile
+    for (int i = 1; i <= numTimeSteps; i ++) {
+        // Synchronize at every time-step
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        real strike = exerciseStrike(strikePrice, dividendEscrows,
+                                     currentNumLattice - 1 - i);
+        for (int j = localId; j < numInputs - i; j += groupSize) {
+            real value = (downWeight * tempIn[j] +
+                         upWeight * tempIn[j + 1])
+                         / discountFactor;
+            tempOut[j] = exercise(value, stockPrice, strike, type,
+                                  upPowers, downPowers, isAmerican,
+                                  offset + j, currentNumLattice - 1 - i);
+        }
+
+        __local real* swap = tempIn;
+        tempIn = tempOut;
+        tempOut = swap;
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+    int numOutputs = min(tileSize, currentNumLattice - numTimeSteps - offset);
+    for (int i = localId; i < numOutputs; i += groupSize) {
+        optionValueOut[offset + i] = tempIn[i];
+    }
+}
+
+__kernel void
+ladderInit(
+        const real stockPrice,
+        __global const real* strikePrices,
+        const int numStrikes,
+        const int numSteps,
+        const int type,
+        __global const real* upPowers,
+        __global const real* downPowers,
+        __global real* valueAtExpiry
+        )
+{
+    // Option values of every strike at a node are stored next to each other
+    int id = get_global_id(0);
+    if (id > numSteps) {
+        return;
+    }
+    real stockPriceAtExpiry = stockPriceAt(stockPrice, upPowers, downPowers,
+                                            id, numSteps);
+    for (int k = 0; k < numStrikes; k++) {
+        valueAtExpiry[id * numStrikes + k] =
+            max(type * (stockPriceAtExpiry - strikePrices[k]), (real) 0);
+    }
+}
+
+__kernel
+void ladder(
+        const real upWeight,
+        const real downWeight,
+        const real discountFactor,
+        __global const real* optionValueIn,
+        __global real* optionValueOut,
+        __local real* tempOptionValue,
+        const int currentNumLattice,
+        const int numTimeSteps,
+        const int tileSize,
+        const int numStrikes,
+        const real stockPrice,
+        __global const real* strikePrices,
+        const int type,
+        __global const real* upPowers,
+        __global const real* downPowers,
+        const int isAmerican,
+        __global const real* dividendEscrows
+        )
+{
+    int localId = get_local_id(0);
+    int groupSize = get_local_size(0);
+    int groupId = get_group_id(0);
+
+    // Same tiling as the trapezoid kernel, but every lattice point holds the
+    // option values of numStrikes strikes on the same tree
+    int offset = tileSize * groupId;
+    int numInputs = min(tileSize + numTimeSteps, currentNumLattice - offset);
+
+    __local real* tempIn = tempOptionValue;
+    __local real* tempOut = tempOptionValue +
+                            (tileSize + numTimeSteps) * numStrikes;
+    for (int i = localId; i < numInputs * numStrikes; i += groupSize) {
+        tempIn[i] = optionValueIn[offset * numStrikes + i];
+    }
+
+    for (int i = 1; i <= numTimeSteps; i ++) {
+        // Synchronize at every time-step
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        // Dividends still to be paid are added back to the node price once
+        // instead of taken from every strike
+        real escrow = 0;
+        if (dividendEscrows != 0) {
+            escrow = dividendEscrows[currentNumLattice - 1 - i];
+        }
+        for (int j = localId; j < numInputs - i; j += groupSize) {
+            // Node price is computed once and shared by every strike
+            real nodeStockPrice = 0;
+            if (isAmerican) {
+                nodeStockPrice = escrow +
+                    stockPriceAt(stockPrice, upPowers, downPowers,
+                                 offset + j, currentNumLattice - 1 - i);
+            }
+            for (int k = 0; k < numStrikes; k++) {
+                real value = (downWeight * tempIn[j * numStrikes + k] +
+                              upWeight * tempIn[(j + 1) * numStrikes + k])
+                              / discountFactor;
+                if (isAmerican) {
+                    value = max(value,
+                                type * (nodeStockPrice - strikePrices[k]));
+                }
+                tempOut[j * numStrikes + k] = value;
+            }
+        }
+
+        __local real* swap = tempIn;
+        tempIn = tempOut;
+        tempOut = swap;
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+    int numOutputs = min(tileSize, currentNumLattice - numTimeSteps - offset);
+    for (int i = localId; i < numOutputs * numStrikes; i += groupSize) {
+        optionValueOut[offset * numStrikes + i] = tempIn[i];
     }
 }
 
 __kernel  
 void upTriangle(
-        const float upWeight,
-        const float downWeight,
-        const float discountFactor,
-        __global float* optionValue,
-        __local float* tempOptionValue,
-        __global float* triangle
+        const real upWeight,
+        const real downWeight,
+        const real discountFactor,
+        __global real* optionValue,
+        __local real* tempOptionValue,
+        __global real* triangle,
+        const real stockPrice,
+        const real strikePrice,
+        const int type,
+        __global const real* upPowers,
+        __global const real* downPowers,
+        const int isAmerican,
+        const int currentStep,
+        __global real* nearRootValues,
+        __global const real* dividendEscrows
         )
 {
     int localId = get_local_id(0);
@@ -62,24 +368,45 @@ void upTriangle(
         // printf("[upTriangle] groupId = %d, stepSize = %d\n", groupId, stepSize);
     }
 
+    // The last launch holds every node from currentStep down to the root,
+    // those of time-steps 0 to 2 are kept for the greeks
+    int isLastLaunch = currentStep == stepSize;
+
     // Copy initial lattice points into temporary buffer
     tempOptionValue[localId] = optionValue[globalId];
+    if (isLastLaunch && currentStep <= 2) {
+        nearRootValues[currentStep * (currentStep + 1) / 2 + localId] =
+            tempOptionValue[localId];
+    }
 
     for (int i = 1 ; i <= stepSize; i ++) {
         // Synchronize at every time-step
         barrier(CLK_LOCAL_MEM_FENCE);
 
         // Calculate preceding option value if lattice point exists
-        float value;
+        real value;
         if (localId <= stepSize - i) {
             value = (downWeight * tempOptionValue[localId] +
                     upWeight * tempOptionValue[localId + 1])
                     / discountFactor;
+            real strike = exerciseStrike(strikePrice, dividendEscrows,
+                                         currentStep - i);
+            value = exercise(value, stockPrice, strike, type,
+                             upPowers, downPowers, isAmerican,
+                             globalId, currentStep - i);
         } 
+
+        // Wait until every work item has read its neighbour before overwriting
+        barrier(CLK_LOCAL_MEM_FENCE);
         
         // Store preceding option value if lattice point exists
         if (localId <= stepSize - i) {
             tempOptionValue[localId] = value;
+
+            int step = currentStep - i;
+            if (isLastLaunch && step <= 2) {
+                nearRootValues[step * (step + 1) / 2 + localId] = value;
+            }
         }
 
         if (localId == 0) {
@@ -100,12 +427,20 @@ void upTriangle(
 }
 __kernel  
 void downTriangle(
-        const float upWeight,
-        const float downWeight,
-        const float discountFactor,
-        __global float* optionValue,
-        __local float* tempOptionValue,
-        __global float* triangle
+        const real upWeight,
+        const real downWeight,
+        const real discountFactor,
+        __global real* optionValue,
+        __local real* tempOptionValue,
+        __global real* triangle,
+        const real stockPrice,
+        const real strikePrice,
+        const int type,
+        __global const real* upPowers,
+        __global const real* downPowers,
+        const int isAmerican,
+        const int currentStep,
+        __global const real* dividendEscrows
         )
 {
     int localId = get_local_id(0);
@@ -124,29 +459,38 @@ void downTriangle(
         // Synchronize at every time-step
         barrier(CLK_LOCAL_MEM_FENCE);
 
-        float value;
-        float upValue;
-        float downValue;
+        real value;
+        real upValue;
+        real downValue;
 
         // Calculate preceding option value with lattice points from different
         // sources depending on index and time-step
-        if (localId == stepSize - 1) {
-            upValue = triangle[offset + stepSize + i];
-        } else {
-            upValue = tempOptionValue[localId + 1];
-        }
+        if (localId >= stepSize - i && localId < stepSize) {
+            if (localId == stepSize - 1) {
+                upValue = triangle[offset + stepSize + i];
+            } else {
+                upValue = tempOptionValue[localId + 1];
+            }
 
-        if (localId == stepSize - i) {
-            downValue = optionValue[globalId];
-        } else {
-            downValue = tempOptionValue[localId];
-        }
+            if (localId == stepSize - i) {
+                downValue = optionValue[globalId];
+            } else {
+                downValue = tempOptionValue[localId];
+            }
 
-        if (localId >= stepSize - i && localId < stepSize) {
             value = (downWeight * downValue+
                     upWeight * upValue)
                     / discountFactor;
+            real strike = exerciseStrike(strikePrice, dividendEscrows,
+                                         currentStep - i - 1);
+            value = exercise(value, stockPrice, strike, type,
+                             upPowers, downPowers, isAmerican,
+                             globalId, currentStep - i - 1);
         } 
+
+        // Wait until every work item has read its neighbour before overwriting
+        barrier(CLK_LOCAL_MEM_FENCE);
+
         if (localId >= stepSize - i && localId < stepSize) {
             tempOptionValue[localId] = value;
         }
@@ -163,3 +507,585 @@ void downTriangle(
     }
 
 }
+
+// Tree parameterizations, matching LatticeModel on the host
+#define LATTICE_CRR 0
+#define LATTICE_JARROW_RUDD 1
+#define LATTICE_TIAN 2
+#define LATTICE_LEISEN_REIMER 3
+#define LATTICE_TRINOMIAL 4
+
+// Dividend column entries per option, matching MAX_DIVIDENDS on the host
+#define MAX_DIVIDENDS 8
+
+// Lattice parameters of one option of a batch
+// Node index of time-step step has the stock price
+//  stockPrice * upFactor^index * downFactor^((numBranches - 1) * step - index)
+// net of the present value of the discrete dividends still to be paid
+typedef struct {
+    real stockPrice;
+    real strikePrice;
+    int type;
+    int isAmerican;
+    int steps;
+    int model;
+    int numBranches;
+    real yearsToMaturity;
+    real upFactor;
+    real downFactor;
+    real upWeight;
+    real middleWeight;
+    real downWeight;
+    real discountFactor;
+    real deltaT;
+    real volatility;
+    real riskFreeRate;
+    real dividendYield;
+    // Discrete dividends of the option in its slices of the dividend
+    // columns
+    int numDividends;
+    __global const float* dividendTimes;
+    __global const float* dividendAmounts;
+} BatchOption;
+
+// Present value at time of the discrete dividends of params paid after time,
+// the same way the host escrows them
+real
+dividendEscrow(
+        const BatchOption* params,
+        const real time
+        )
+{
+    real escrow = 0;
+    for (int k = 0; k < params->numDividends && k < MAX_DIVIDENDS; k ++) {
+        real dividendTime = params->dividendTimes[k];
+        if (dividendTime > time) {
+            escrow += params->dividendAmounts[k] *
+                      exp(-params->riskFreeRate * (dividendTime - time));
+        }
+    }
+    return escrow;
+}
+
+// Strike of early exercise at time-step step of the option of params
+real
+batchExerciseStrike(
+        const BatchOption* params,
+        const int step
+        )
+{
+    if (params->numDividends == 0) {
+        return params->strikePrice;
+    }
+    return params->strikePrice - dividendEscrow(params, step * params->deltaT);
+}
+
+// Time-steps of a lattice of latticeModel asked for numSteps, rounded up to
+// odd ones under Leisen-Reimer as on the host
+int
+latticeSteps(
+        const int latticeModel,
+        const int numSteps
+        )
+{
+    if (latticeModel == LATTICE_LEISEN_REIMER && numSteps % 2 == 0) {
+        return numSteps + 1;
+    }
+    return numSteps;
+}
+
+// Peizer-Pratt inversion, the probability of a binomial tree of numSteps
+// time-steps matching the normal probability of z
+real
+peizerPratt(
+        const real z,
+        const int numSteps
+        )
+{
+    real x = z / (numSteps + (real) 1 / 3 + (real) 0.1 / (numSteps + 1));
+    real root = (real) 0.5 * sqrt(1 - exp(-x * x * (numSteps + (real) 1 / 6)));
+    return z < 0 ? (real) 0.5 - root : (real) 0.5 + root;
+}
+
+// Tree factors and weights of params for volatility in the model of params,
+// the same way the host derives them for single options
+void
+treeFactors(
+        BatchOption* params,
+        const real volatility,
+        const float deltaT,
+        const real riskFreeRate
+        )
+{
+    real dt = deltaT;
+    params->deltaT = deltaT;
+    params->volatility = volatility;
+    params->riskFreeRate = riskFreeRate;
+    params->discountFactor = exp(riskFreeRate * dt);
+    params->numBranches = params->model == LATTICE_TRINOMIAL ? 3 : 2;
+    params->middleWeight = 0;
+
+    // The stock price drifts at the cost of carry
+    real carryRate = riskFreeRate - params->dividendYield;
+    real carryFactor = exp(carryRate * dt);
+    if (params->model == LATTICE_JARROW_RUDD) {
+        real drift = (carryRate - (real) 0.5 * volatility * volatility) * dt;
+        params->upFactor = exp(drift + volatility * sqrt(dt));
+        params->downFactor = exp(drift - volatility * sqrt(dt));
+    } else if (params->model == LATTICE_TIAN) {
+        real variance = exp(volatility * volatility * dt);
+        real root = sqrt(variance * variance + 2 * variance - 3);
+        params->upFactor = (real) 0.5 * carryFactor * variance *
+                           (variance + 1 + root);
+        params->downFactor = (real) 0.5 * carryFactor * variance *
+                             (variance + 1 - root);
+    } else if (params->model == LATTICE_LEISEN_REIMER) {
+        real volatilityTime = volatility * sqrt(params->yearsToMaturity);
+        real d1 = (log(params->stockPrice / params->strikePrice) +
+                   (carryRate + (real) 0.5 * volatility * volatility) *
+                   params->yearsToMaturity) / volatilityTime;
+        real d2 = d1 - volatilityTime;
+        real weight = peizerPratt(d2, params->steps);
+        params->upFactor = carryFactor * peizerPratt(d1, params->steps) /
+                           weight;
+        params->downFactor = (carryFactor - weight * params->upFactor) /
+                             (1 - weight);
+    } else if (params->model == LATTICE_TRINOMIAL) {
+        params->upFactor = exp(volatility * sqrt((real) 0.5 * dt));
+        params->downFactor = 1 / params->upFactor;
+    } else {
+        params->upFactor = exp(volatility * sqrt(dt));
+        params->downFactor = 1 / params->upFactor;
+    }
+
+    real spread = params->upFactor - params->downFactor;
+    if (params->numBranches == 3) {
+        real growth = exp((real) 0.5 * carryRate * dt);
+        real up = (growth - params->downFactor) / spread;
+        real down = (params->upFactor - growth) / spread;
+        params->upWeight = up * up;
+        params->downWeight = down * down;
+        params->middleWeight = 1 - params->upWeight - params->downWeight;
+    } else {
+        params->upWeight = (carryFactor - params->downFactor) / spread;
+        params->downWeight = 1 - params->upWeight;
+    }
+}
+
+// Lattice parameters of option, derived from the columns of an OptionBatch
+BatchOption
+batchOption(
+        __global const int* type,
+        __global const float* stockPrice,
+        __global const float* strikePrice,
+        __global const float* yearsToMaturity,
+        __global const float* volatility,
+        __global const float* riskFreeRate,
+        __global const int* numSteps,
+        __global const int* isAmerican,
+        __global const float* dividendYield,
+        __global const int* numDividends,
+        __global const float* dividendTimes,
+        __global const float* dividendAmounts,
+        const int option,
+        const int latticeModel
+        )
+{
+    BatchOption params;
+    params.stockPrice = stockPrice[option];
+    params.strikePrice = strikePrice[option];
+    params.type = type[option];
+    params.isAmerican = isAmerican[option];
+    params.steps = latticeSteps(latticeModel, numSteps[option]);
+    params.model = latticeModel;
+    params.yearsToMaturity = yearsToMaturity[option];
+    params.riskFreeRate = riskFreeRate[option];
+    params.dividendYield = dividendYield[option];
+    params.numDividends = numDividends[option];
+    params.dividendTimes = dividendTimes + MAX_DIVIDENDS * option;
+    params.dividendAmounts = dividendAmounts + MAX_DIVIDENDS * option;
+    params.stockPrice -= dividendEscrow(&params, 0);
+
+    // deltaT is rounded to float like on the host
+    float deltaT = yearsToMaturity[option] / params.steps;
+    treeFactors(&params, volatility[option], deltaT, riskFreeRate[option]);
+    return params;
+}
+
+// Fills upPowers[k] = upFactor^k and downPowers[k] = downFactor^k for
+// k = first, first + stride, ... up to numSteps
+void
+fillPowers(
+        __global real* upPowers,
+        __global real* downPowers,
+        const real upFactor,
+        const real downFactor,
+        const int numSteps,
+        const int first,
+        const int stride
+        )
+{
+    for (int k = first; k <= numSteps; k += stride) {
+        upPowers[k] = pown(upFactor, k);
+        downPowers[k] = pown(downFactor, k);
+    }
+}
+
+// Prices the option of params with the whole work group, returning its
+// price to every work-item
+// The lattice is double buffered in twice the points of its last time-step
+// in optionValue, and node price tables filled in the same layout of powers
+// isSmoothed values the last time-step with Black-Scholes
+real
+walkLattice(
+        const BatchOption params,
+        __global real* optionValue,
+        __global real* powers,
+        const int isSmoothed
+        )
+{
+    int localId = get_local_id(0);
+    int groupSize = get_local_size(0);
+    int steps = params.steps;
+    int span = params.numBranches - 1;
+
+    __global real* optionValueIn = optionValue;
+    __global real* optionValueOut = optionValueIn + span * steps + 1;
+
+    __global real* upPowers = powers;
+    __global real* downPowers = upPowers + span * steps + 1;
+    fillPowers(upPowers, downPowers, params.upFactor, params.downFactor,
+               span * steps, localId, groupSize);
+    barrier(CLK_GLOBAL_MEM_FENCE);
+
+    // Calculate option value at expiry
+    real timeToExpiry = isSmoothed ? params.deltaT : 0;
+    real expiryStrike = batchExerciseStrike(&params, steps);
+    for (int i = localId; i <= span * steps; i += groupSize) {
+        real stockPriceAtExpiry = stockPriceAt(params.stockPrice, upPowers,
+                                                downPowers, i, span * steps);
+        optionValueIn[i] = expiryValue(stockPriceAtExpiry, params.strikePrice,
+                                       expiryStrike, params.type,
+                                       params.isAmerican, timeToExpiry,
+                                       params.volatility, params.riskFreeRate,
+                                       params.dividendYield);
+    }
+
+    for (int i = steps; i > 0; i--) {
+        // Synchronize at every time-step
+        barrier(CLK_GLOBAL_MEM_FENCE);
+
+        real strike = batchExerciseStrike(&params, i - 1);
+        for (int j = localId; j <= span * (i - 1); j += groupSize) {
+            real value = params.downWeight * optionValueIn[j];
+            if (span == 2) {
+                value += params.middleWeight * optionValueIn[j + 1];
+            }
+            value = (value + params.upWeight * optionValueIn[j + span])
+                    / params.discountFactor;
+            optionValueOut[j] = exercise(value, params.stockPrice,
+                                         strike, params.type,
+                                         upPowers, downPowers,
+                                         params.isAmerican, j,
+                                         span * (i - 1));
+        }
+
+        __global real* swap = optionValueIn;
+        optionValueIn = optionValueOut;
+        optionValueOut = swap;
+    }
+
+    barrier(CLK_GLOBAL_MEM_FENCE);
+    real value = optionValueIn[0];
+
+    // Every work-item holds the price before the lattice is walked again
+    barrier(CLK_GLOBAL_MEM_FENCE);
+    return value;
+}
+
+__kernel
+void batch(
+        __global const int* type,
+        __global const float* stockPrice,
+        __global const float* strikePrice,
+        __global const float* yearsToMaturity,
+        __global const float* volatility,
+        __global const float* riskFreeRate,
+        __global const int* numSteps,
+        __global const int* isAmerican,
+        __global const float* dividendYield,
+        __global const int* numDividends,
+        __global const float* dividendTimes,
+        __global const float* dividendAmounts,
+        __global const int* offsets,
+        __global real* optionValue,
+        __global real* result,
+        __global real* powers,
+        const int isSmoothed,
+        const int latticeModel
+        )
+{
+    // Each work group prices one option of the batch
+    int localId = get_local_id(0);
+    int option = get_group_id(0);
+
+    BatchOption params = batchOption(type, stockPrice, strikePrice,
+                                     yearsToMaturity, volatility,
+                                     riskFreeRate, numSteps, isAmerican,
+                                     dividendYield, numDividends,
+                                     dividendTimes, dividendAmounts,
+                                     option, latticeModel);
+
+    // Lattice and node price tables of option live in its slices of the
+    // global buffers
+    real value = walkLattice(params, optionValue + offsets[option],
+                             powers + offsets[option], isSmoothed);
+    if (localId == 0) {
+        result[option] = value;
+    }
+}
+
+__kernel
+void batchLocal(
+        __global const int* type,
+        __global const float* stockPrice,
+        __global const float* strikePrice,
+        __global const float* yearsToMaturity,
+        __global const float* volatility,
+        __global const float* riskFreeRate,
+        __global const int* numSteps,
+        __global const int* isAmerican,
+        __global const float* dividendYield,
+        __global const int* numDividends,
+        __global const float* dividendTimes,
+        __global const float* dividendAmounts,
+        __global const int* offsets,
+        __global real* result,
+        __global real* powers,
+        __local real* optionValue,
+        const int isSmoothed,
+        const int latticeModel
+        )
+{
+    // Each work group prices one option with its lattice held in local memory
+    int localId = get_local_id(0);
+    int groupSize = get_local_size(0);
+    int option = get_group_id(0);
+
+    BatchOption params = batchOption(type, stockPrice, strikePrice,
+                                     yearsToMaturity, volatility,
+                                     riskFreeRate, numSteps, isAmerican,
+                                     dividendYield, numDividends,
+                                     dividendTimes, dividendAmounts,
+                                     option, latticeModel);
+    int steps = params.steps;
+    int span = params.numBranches - 1;
+
+    // Lattice is double buffered in local memory
+    __local real* optionValueIn = optionValue;
+    __local real* optionValueOut = optionValue + span * steps + 1;
+
+    __global real* upPowers = powers + offsets[option];
+    __global real* downPowers = upPowers + span * steps + 1;
+    fillPowers(upPowers, downPowers, params.upFactor, params.downFactor,
+               span * steps, localId, groupSize);
+    barrier(CLK_GLOBAL_MEM_FENCE);
+
+    // Calculate option value at expiry
+    real timeToExpiry = isSmoothed ? params.deltaT : 0;
+    real expiryStrike = batchExerciseStrike(&params, steps);
+    for (int i = localId; i <= span * steps; i += groupSize) {
+        real stockPriceAtExpiry = stockPriceAt(params.stockPrice, upPowers,
+                                               downPowers, i, span * steps);
+        optionValueIn[i] = expiryValue(stockPriceAtExpiry, params.strikePrice,
+                                       expiryStrike, params.type,
+                                       params.isAmerican, timeToExpiry,
+                                       params.volatility, params.riskFreeRate,
+                                       params.dividendYield);
+    }
+
+    for (int i = steps; i > 0; i--) {
+        // Synchronize at every time-step
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        real strike = batchExerciseStrike(&params, i - 1);
+        for (int j = localId; j <= span * (i - 1); j += groupSize) {
+            real value = params.downWeight * optionValueIn[j];
+            if (span == 2) {
+                value += params.middleWeight * optionValueIn[j + 1];
+            }
+            value = (value + params.upWeight * optionValueIn[j + span])
+                    / params.discountFactor;
+            optionValueOut[j] = exercise(value, params.stockPrice,
+                                         strike, params.type,
+                                         upPowers, downPowers,
+                                         params.isAmerican, j,
+                                         span * (i - 1));
+        }
+
+        __local real* swap = optionValueIn;
+        optionValueIn = optionValueOut;
+        optionValueOut = swap;
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+    if (localId == 0) {
+        result[option] = optionValueIn[0];
+    }
+}
+
+__kernel
+void batchItem(
+        __global const int* type,
+        __global const float* stockPrice,
+        __global const float* strikePrice,
+        __global const float* yearsToMaturity,
+        __global const float* volatility,
+        __global const float* riskFreeRate,
+        __global const int* numSteps,
+        __global const int* isAmerican,
+        __global const float* dividendYield,
+        __global const int* numDividends,
+        __global const float* dividendTimes,
+        __global const float* dividendAmounts,
+        __global const int* offsets,
+        __global real* result,
+        __global real* powers,
+        __local real* optionValue,
+        const int numOptions,
+        const int latticeSize,
+        const int isSmoothed,
+        const int latticeModel
+        )
+{
+    // Each work item prices one option alone in its slice of local memory
+    int option = get_global_id(0);
+    if (option >= numOptions) {
+        return;
+    }
+
+    BatchOption params = batchOption(type, stockPrice, strikePrice,
+                                     yearsToMaturity, volatility,
+                                     riskFreeRate, numSteps, isAmerican,
+                                     dividendYield, numDividends,
+                                     dividendTimes, dividendAmounts,
+                                     option, latticeModel);
+    int steps = params.steps;
+    int span = params.numBranches - 1;
+    __local real* lattice = optionValue + get_local_id(0) * latticeSize;
+
+    __global real* upPowers = powers + offsets[option];
+    __global real* downPowers = upPowers + span * steps + 1;
+    fillPowers(upPowers, downPowers, params.upFactor, params.downFactor,
+               span * steps, 0, 1);
+
+    // Calculate option value at expiry
+    real timeToExpiry = isSmoothed ? params.deltaT : 0;
+    real expiryStrike = batchExerciseStrike(&params, steps);
+    for (int i = 0; i <= span * steps; i++) {
+        real stockPriceAtExpiry = stockPriceAt(params.stockPrice, upPowers,
+                                               downPowers, i, span * steps);
+        lattice[i] = expiryValue(stockPriceAtExpiry, params.strikePrice,
+                                 expiryStrike, params.type, params.isAmerican,
+                                 timeToExpiry, params.volatility,
+                                 params.riskFreeRate, params.dividendYield);
+    }
+
+    // Iterate backwards in place, node j only depends on nodes j to
+    // j + span
+    for (int i = steps; i > 0; i--) {
+        real strike = batchExerciseStrike(&params, i - 1);
+        for (int j = 0; j <= span * (i - 1); j++) {
+            real value = params.downWeight * lattice[j];
+            if (span == 2) {
+                value += params.middleWeight * lattice[j + 1];
+            }
+            value = (value + params.upWeight * lattice[j + span])
+                    / params.discountFactor;
+            lattice[j] = exercise(value, params.stockPrice,
+                                  strike, params.type,
+                                  upPowers, downPowers, params.isAmerican,
+                                  j, span * (i - 1));
+        }
+    }
+
+    result[option] = lattice[0];
+}
+
+__kernel
+void impliedVolatility(
+        __global const int* type,
+        __global const float* stockPrice,
+        __global const float* strikePrice,
+        __global const float* yearsToMaturity,
+        __global const float* volatility,
+        __global const float* riskFreeRate,
+        __global const int* numSteps,
+        __global const int* isAmerican,
+        __global const float* dividendYield,
+        __global const int* numDividends,
+        __global const float* dividendTimes,
+        __global const float* dividendAmounts,
+        __global const int* offsets,
+        __global real* optionValue,
+        __global real* powers,
+        __global const real* marketPrice,
+        __global const real* initialVolatility,
+        __global real* result,
+        const real minVolatility,
+        const real maxVolatility,
+        const real volatilityBump,
+        const real tolerance,
+        const int maxIterations,
+        const int latticeModel
+        )
+{
+    // Each work group searches the volatility of one option, walking its
+    // lattice twice per iteration for the price and the vega
+    int localId = get_local_id(0);
+    int option = get_group_id(0);
+
+    BatchOption params = batchOption(type, stockPrice, strikePrice,
+                                     yearsToMaturity, volatility,
+                                     riskFreeRate, numSteps, isAmerican,
+                                     dividendYield, numDividends,
+                                     dividendTimes, dividendAmounts,
+                                     option, latticeModel);
+    float deltaT = params.deltaT;
+    __global real* lattice = optionValue + offsets[option];
+    __global real* latticePowers = powers + offsets[option];
+
+    // Same safeguarded Newton iteration as VolatilitySearch on the host,
+    // every work-item takes the same branches on the same prices
+    real target = marketPrice[option];
+    real low = minVolatility;
+    real high = maxVolatility;
+    real sigma = clamp(initialVolatility[option], low, high);
+    for (int i = 0; i < maxIterations; i ++) {
+        treeFactors(&params, sigma, deltaT, riskFreeRate[option]);
+        real value = walkLattice(params, lattice, latticePowers, 0);
+        treeFactors(&params, sigma + volatilityBump, deltaT,
+                    riskFreeRate[option]);
+        real vega = (walkLattice(params, lattice, latticePowers, 0) - value) /
+                    volatilityBump;
+
+        if (value > target) {
+            high = sigma;
+        } else {
+            low = sigma;
+        }
+        real next = sigma - (value - target) / vega;
+        if (!(next > low && next < high)) {
+            next = (low + high) / 2;
+        }
+        real step = fabs(next - sigma);
+        sigma = next;
+        if (step < tolerance) {
+            break;
+        }
+    }
+
+    if (localId == 0) {
+        result[option] = sigma;
+    }
+}
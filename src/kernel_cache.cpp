@@ -0,0 +1,132 @@
+// System Libraries
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <iostream>
+#include <cstdio>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// OpenCL C++ Binding
+#include "cl.hpp"
+
+#include "kernel_cache.h"
+
+// 64-bit FNV-1a hash, rendered in hex for use in file names
+static std::string hashString(const std::string& text) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < text.size(); i++) {
+        hash ^= (unsigned char) text[i];
+        hash *= 1099511628211ULL;
+    }
+    std::ostringstream oss;
+    oss << std::hex << hash;
+    return oss.str();
+}
+
+KernelCache::KernelCache(const std::string& directory): directory(directory) {
+    if (!directory.empty()) {
+        // Fails harmlessly when the directory already exists
+        mkdir(directory.c_str(), 0755);
+    }
+}
+
+cl::Program* KernelCache::build(cl::Context* context, cl::Platform* platform,
+                                cl::Device* device, const std::string& source,
+                                const std::string& options,
+                                std::string* buildLog) {
+    // Source is hashed so the key stays one line, the file name hashes it all
+    std::string key = platform->getInfo<CL_PLATFORM_NAME>() + "|" +
+                      device->getInfo<CL_DEVICE_NAME>() + "|" +
+                      device->getInfo<CL_DRIVER_VERSION>() + "|" +
+                      options + "|" + hashString(source);
+    std::string path = directory + "/" + hashString(key) + ".bin";
+
+    if (!directory.empty()) {
+        cl::Program* program = load(context, device, path, key, options);
+        if (program != NULL) {
+            std::cout   << "[INFO] Loaded kernel binary from " << path
+                        << std::endl;
+            return program;
+        }
+    }
+
+    cl::Program::Sources sources;
+    sources.push_back({source.c_str(), source.length()});
+    cl::Program* program = new cl::Program(*context, sources);
+    if (program->build({*device}, options.c_str()) != CL_SUCCESS) {
+        *buildLog = program->getBuildInfo<CL_PROGRAM_BUILD_LOG>(*device);
+        delete program;
+        return NULL;
+    }
+
+    if (!directory.empty()) {
+        store(program, path, key);
+    }
+    return program;
+}
+
+/**
+ * Entry files hold the full key on the first line followed by the binary,
+ * so a hash collision on the file name is detected instead of loaded
+ */
+cl::Program* KernelCache::load(cl::Context* context, cl::Device* device,
+                               const std::string& path, const std::string& key,
+                               const std::string& options) {
+    std::ifstream ifs(path.c_str(), std::ios::binary);
+    std::string entryKey;
+    if (!ifs || !std::getline(ifs, entryKey) || entryKey != key) {
+        return NULL;
+    }
+    std::string binary((std::istreambuf_iterator<char>(ifs)),
+                       (std::istreambuf_iterator<char>()));
+    if (binary.empty()) {
+        return NULL;
+    }
+
+    cl::Program::Binaries binaries;
+    binaries.push_back(std::make_pair((const void*) binary.data(),
+                                      binary.size()));
+    std::vector<cl_int> binaryStatus;
+    cl_int err;
+    cl::Program* program = new cl::Program(*context, {*device}, binaries,
+                                           &binaryStatus, &err);
+    if (err != CL_SUCCESS ||
+        program->build({*device}, options.c_str()) != CL_SUCCESS) {
+        std::cout   << "[INFO] Ignoring stale kernel binary " << path
+                    << std::endl;
+        delete program;
+        return NULL;
+    }
+    return program;
+}
+
+void KernelCache::store(cl::Program* program, const std::string& path,
+                        const std::string& key) {
+    std::vector<size_t> sizes = program->getInfo<CL_PROGRAM_BINARY_SIZES>();
+    if (sizes.size() != 1 || sizes[0] == 0) {
+        return;
+    }
+    std::vector<char*> binaries = program->getInfo<CL_PROGRAM_BINARIES>();
+
+    // Write to a private file and rename it into place, so that processes
+    // starting concurrently never read a partial entry
+    std::ostringstream tempPath;
+    tempPath << path << ".tmp." << getpid();
+    std::ofstream ofs(tempPath.str().c_str(), std::ios::binary);
+    ofs << key << '\n';
+    ofs.write(binaries[0], sizes[0]);
+    ofs.close();
+    if (!ofs || rename(tempPath.str().c_str(), path.c_str()) != 0) {
+        std::cerr   << "[ERROR] Could not write kernel binary to " << path
+                    << std::endl;
+        remove(tempPath.str().c_str());
+    }
+
+    for (size_t i = 0; i < binaries.size(); i++) {
+        delete[] binaries[i];
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef __KERNEL_CACHE_H__
+#define __KERNEL_CACHE_H__
+// System Libraries
+#include <string>
+
+// OpenCL C++ Binding
+#include "cl.hpp"
+
+/**
+ * On-disk cache of program binaries built from kernel source
+ *
+ * Entries are keyed by platform and device name, driver version, build
+ * options and the kernel source, so that a new driver or an edited kernel
+ * never loads a stale binary. A miss, or a cached binary the driver rejects,
+ * falls back to building from source and refreshes the entry.
+ */
+class KernelCache {
+public:
+    // An empty directory disables the cache
+    KernelCache(const std::string& directory);
+    // Returns a program built for device, or NULL with buildLog set when
+    // the source fails to build
+    cl::Program* build(cl::Context* context, cl::Platform* platform,
+                       cl::Device* device, const std::string& source,
+                       const std::string& options, std::string* buildLog);
+private:
+    cl::Program* load(cl::Context* context, cl::Device* device,
+                      const std::string& path, const std::string& key,
+                      const std::string& options);
+    void store(cl::Program* program, const std::string& path,
+               const std::string& key);
+
+    std::string directory;
+};
+#endif
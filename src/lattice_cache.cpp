@@ -0,0 +1,197 @@
+// System Libraries
+#include <cmath>
+#include <vector>
+#include <memory>
+#include <mutex>
+
+#include "option_spec.h"
+#include "lattice_cache.h"
+#include "lattice_kernels.h"
+
+LatticeKey::LatticeKey(const OptionSpec& optionSpec, LatticeModel model):
+    stockPrice(optionSpec.stockPrice - dividendEscrow(optionSpec, 0)),
+    yearsToMaturity(optionSpec.yearsToMaturity),
+    volatility(optionSpec.volatility),
+    riskFreeRate(optionSpec.riskFreeRate),
+    dividendYield(optionSpec.dividendYield),
+    numSteps(optionSpec.numSteps),
+    model(model),
+    strikePrice(model == LATTICE_LEISEN_REIMER ? optionSpec.strikePrice : 0) {
+}
+
+bool LatticeKey::operator<(const LatticeKey& other) const {
+    if (numSteps != other.numSteps) {
+        return numSteps < other.numSteps;
+    }
+    if (model != other.model) {
+        return model < other.model;
+    }
+    if (strikePrice != other.strikePrice) {
+        return strikePrice < other.strikePrice;
+    }
+    if (stockPrice != other.stockPrice) {
+        return stockPrice < other.stockPrice;
+    }
+    if (yearsToMaturity != other.yearsToMaturity) {
+        return yearsToMaturity < other.yearsToMaturity;
+    }
+    if (volatility != other.volatility) {
+        return volatility < other.volatility;
+    }
+    if (dividendYield != other.dividendYield) {
+        return dividendYield < other.dividendYield;
+    }
+    return riskFreeRate < other.riskFreeRate;
+}
+
+// Peizer-Pratt inversion, the probability of a binomial tree of numSteps
+// time-steps matching the normal probability of z
+static double peizerPratt(double z, int numSteps) {
+    double x = z / (numSteps + 1.0 / 3 + 0.1 / (numSteps + 1));
+    double root = 0.5 * sqrt(1 - exp(-x * x * (numSteps + 1.0 / 6)));
+    return z < 0 ? 0.5 - root : 0.5 + root;
+}
+
+/**
+ * Binomial models only differ in their factors, the weights are the risk
+ * neutral ones of the factors. The trinomial tree has branch factors
+ * exp(+-volatility * sqrt(2 * deltaT)) and matches the drift and variance
+ * of the stock price over the time-step
+ * The stock price drifts at the cost of carry, the risk free rate less the
+ * dividend yield, while option values are discounted at the risk free rate
+ */
+Lattice::Lattice(const LatticeKey& key) {
+    // ------------------------Derived Parameters------------------------------
+    stockPrice = key.stockPrice;
+    deltaT = key.yearsToMaturity / key.numSteps;
+    discountFactor = exp(key.riskFreeRate * deltaT);
+    double carryRate = key.riskFreeRate - key.dividendYield;
+    carryFactor = exp(carryRate * deltaT);
+    numBranches = latticeBranches(key.model);
+    middleWeight = 0;
+
+    double volatility = key.volatility;
+    if (key.model == LATTICE_JARROW_RUDD) {
+        double drift = (carryRate - 0.5 * volatility * volatility) * deltaT;
+        upFactor = exp(drift + volatility * sqrt(deltaT));
+        downFactor = exp(drift - volatility * sqrt(deltaT));
+    } else if (key.model == LATTICE_TIAN) {
+        double variance = exp(volatility * volatility * deltaT);
+        double root = sqrt(variance * variance + 2 * variance - 3);
+        upFactor = 0.5 * carryFactor * variance * (variance + 1 + root);
+        downFactor = 0.5 * carryFactor * variance * (variance + 1 - root);
+    } else if (key.model == LATTICE_LEISEN_REIMER) {
+        double volatilityTime = volatility * sqrt(key.yearsToMaturity);
+        double d1 = (log(key.stockPrice / key.strikePrice) +
+                     (carryRate + 0.5 * volatility * volatility) *
+                     key.yearsToMaturity) / volatilityTime;
+        double d2 = d1 - volatilityTime;
+        double weight = peizerPratt(d2, key.numSteps);
+        upFactor = carryFactor * peizerPratt(d1, key.numSteps) / weight;
+        downFactor = (carryFactor - weight * upFactor) / (1 - weight);
+    } else if (key.model == LATTICE_TRINOMIAL) {
+        upFactor = exp(volatility * sqrt(0.5 * deltaT));
+        downFactor = 1.0 / upFactor;
+    } else {
+        upFactor = exp(volatility * sqrt(deltaT));
+        downFactor = 1.0 / upFactor;
+    }
+
+    if (numBranches == 3) {
+        double growth = exp(0.5 * carryRate * deltaT);
+        upWeight = pow((growth - downFactor) / (upFactor - downFactor), 2);
+        downWeight = pow((upFactor - growth) / (upFactor - downFactor), 2);
+        middleWeight = 1.0 - upWeight - downWeight;
+    } else {
+        upWeight = (carryFactor - downFactor) / (upFactor - downFactor);
+        downWeight = 1.0 - upWeight;
+    }
+
+    int numTerminalNodes = numNodes(key.numSteps);
+    terminalPrices.resize(numTerminalNodes);
+    nodePrices(&terminalPrices[0], key.stockPrice, upFactor, downFactor,
+               numTerminalNodes - 1, 0, numTerminalNodes);
+}
+
+/**
+ * Delta from the two nodes of time-step 1, gamma from the change in delta
+ * across the three nodes of time-step 2, and theta from the middle node of
+ * time-step 2. That node has the stock price of the root under CRR only, so
+ * the change in value its price move explains through delta and gamma is
+ * taken out of theta
+ * Trinomial lattices take all three from the three nodes of time-step 1
+ */
+OptionGreeks Lattice::greeks(const double* nearRootValues) const {
+    if (numBranches == 3) {
+        const double* step1Values = nearRootValues + 1;
+        double upPrice = stockPrice * upFactor / downFactor;
+        double downPrice = stockPrice * downFactor / upFactor;
+        double upDelta = (step1Values[2] - step1Values[1]) /
+                         (upPrice - stockPrice);
+        double downDelta = (step1Values[1] - step1Values[0]) /
+                           (stockPrice - downPrice);
+
+        OptionGreeks greeks;
+        greeks.price = nearRootValues[0];
+        greeks.delta = (step1Values[2] - step1Values[0]) /
+                       (upPrice - downPrice);
+        greeks.gamma = (upDelta - downDelta) / (0.5 * (upPrice - downPrice));
+        greeks.theta = (step1Values[1] - nearRootValues[0]) / deltaT;
+        return greeks;
+    }
+
+    const double* step1Values = nearRootValues + 1;
+    const double* step2Values = nearRootValues + 3;
+    double upPrice = stockPrice * upFactor;
+    double downPrice = stockPrice * downFactor;
+    double upUpPrice = upPrice * upFactor;
+    double upDownPrice = upPrice * downFactor;
+    double downDownPrice = downPrice * downFactor;
+
+    OptionGreeks greeks;
+    greeks.price = nearRootValues[0];
+    greeks.delta = (step1Values[1] - step1Values[0]) / (upPrice - downPrice);
+    double upDelta = (step2Values[2] - step2Values[1]) /
+                     (upUpPrice - upDownPrice);
+    double downDelta = (step2Values[1] - step2Values[0]) /
+                       (upDownPrice - downDownPrice);
+    greeks.gamma = (upDelta - downDelta) / (0.5 * (upUpPrice - downDownPrice));
+    double priceMove = upDownPrice - stockPrice;
+    greeks.theta = (step2Values[1] - nearRootValues[0] -
+                    greeks.delta * priceMove -
+                    0.5 * greeks.gamma * priceMove * priceMove) /
+                   (2 * deltaT);
+    return greeks;
+}
+
+LatticeCache::LatticeCache(size_t capacity): capacity(capacity) {
+}
+
+std::shared_ptr<const Lattice> LatticeCache::get(
+        const OptionSpec& optionSpec, LatticeModel model) {
+    LatticeKey key(optionSpec, model);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::map<LatticeKey, LatticeList::iterator>::iterator it =
+            index.find(key);
+        if (it != index.end()) {
+            lattices.splice(lattices.begin(), lattices, it->second);
+            return it->second->second;
+        }
+    }
+
+    // Derived outside the lock so that workers missing on different
+    // lattices do not wait for each other
+    std::shared_ptr<const Lattice> lattice(new Lattice(key));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (index.find(key) == index.end()) {
+        lattices.push_front(std::make_pair(key, lattice));
+        index[key] = lattices.begin();
+        if (lattices.size() > capacity) {
+            index.erase(lattices.back().first);
+            lattices.pop_back();
+        }
+    }
+    return lattice;
+}
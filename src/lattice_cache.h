@@ -0,0 +1,138 @@
+#ifndef __LATTICE_CACHE_H__
+#define __LATTICE_CACHE_H__
+// System Libraries
+#include <vector>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "option_spec.h"
+
+// Tree parameterizations of a lattice
+enum LatticeModel {
+    // Cox-Ross-Rubinstein, upFactor * downFactor = 1
+    LATTICE_CRR,
+    // Jarrow-Rudd factors centred on the drift, with risk neutral weights
+    LATTICE_JARROW_RUDD,
+    // Tian, matching the first three moments of the stock price
+    LATTICE_TIAN,
+    // Leisen-Reimer, centred on the strike by Peizer-Pratt inversion, whose
+    // lattices always have an odd number of time-steps
+    LATTICE_LEISEN_REIMER,
+    // Trinomial tree with a middle branch keeping the stock price
+    LATTICE_TRINOMIAL
+};
+
+// Branches from every node of the lattices of model
+inline int latticeBranches(LatticeModel model) {
+    return model == LATTICE_TRINOMIAL ? 3 : 2;
+}
+
+// Time-steps of a lattice of model asked for numSteps. Leisen-Reimer only
+// converges at O(1/N^2) over odd numSteps, even ones are rounded up
+inline int latticeSteps(LatticeModel model, int numSteps) {
+    if (model == LATTICE_LEISEN_REIMER && numSteps % 2 == 0) {
+        return numSteps + 1;
+    }
+    return numSteps;
+}
+
+// Tree parameters that determine a lattice, shared by every strike and type
+// except under Leisen-Reimer, whose tree is centred on the strike
+struct LatticeKey {
+    // Net of the present value of the discrete dividends, which the lattice
+    // leaves out
+    double stockPrice;
+    float yearsToMaturity;
+    float volatility;
+    float riskFreeRate;
+    float dividendYield;
+    int numSteps;
+    LatticeModel model;
+    // Zero unless the model depends on the strike
+    float strikePrice;
+
+    LatticeKey(const OptionSpec& optionSpec,
+               LatticeModel model = LATTICE_CRR);
+    bool operator<(const LatticeKey& other) const;
+};
+
+// Option values at the 1 + 2 + 3 nodes of time-steps 0 to 2, time-step by
+// time-step from the lowest node, or at the 1 + 3 nodes of time-steps 0 and
+// 1 of trinomial lattices
+#define NUM_NEAR_ROOT_VALUES 6
+
+/**
+ * Constants and terminal node prices derived from a LatticeKey
+ *
+ * Node index of time-step step has the stock price
+ *      stockPrice * upFactor^index * downFactor^(numNodes(step) - 1 - index)
+ * so trinomial lattices hold the square roots of their branch factors, and
+ * node index is reached from nodes index to index + numBranches - 1 of the
+ * next time-step.
+ */
+struct Lattice {
+    Lattice(const LatticeKey& key);
+    // Greeks by finite differences over the nodes near the root, which
+    // already hold the stock price bumps of the tree
+    OptionGreeks greeks(const double* nearRootValues) const;
+    // Strike that early exercise of optionSpec compares the node prices of
+    // time-step step with, less the dividends still to be paid, which the
+    // node prices are net of
+    double exerciseStrike(const OptionSpec& optionSpec, int step) const {
+        if (optionSpec.numDividends == 0) {
+            return optionSpec.strikePrice;
+        }
+        return optionSpec.strikePrice -
+               dividendEscrow(optionSpec, step * deltaT);
+    }
+    // Nodes of time-step step
+    int numNodes(int step) const {
+        return (numBranches - 1) * step + 1;
+    }
+
+    int numBranches;
+    // Stock price at the root, net of the discrete dividends
+    double stockPrice;
+    double deltaT;
+    double upFactor;
+    double downFactor;
+    double discountFactor;
+    // Expected growth of the stock price over a time-step, the discount
+    // factor less the dividend yield
+    double carryFactor;
+    // Risk neutral weights, without the discounting, middleWeight is zero
+    // on binomial lattices
+    double upWeight;
+    double middleWeight;
+    double downWeight;
+    // Stock prices at the numNodes(numSteps) nodes of the last time-step
+    std::vector<double> terminalPrices;
+};
+
+/**
+ * Least recently used cache of lattices
+ *
+ * Options differing only in strike or type share a lattice, so a strike
+ * ladder derives its tree once. Lattices are handed out as shared pointers,
+ * so eviction never invalidates one in use. Thread safe, so that the
+ * workers of a ParallelPricer can share it.
+ */
+class LatticeCache {
+public:
+    LatticeCache(size_t capacity = 32);
+    // Cached lattice of optionSpec, derived and inserted on a miss
+    std::shared_ptr<const Lattice> get(const OptionSpec& optionSpec,
+                                       LatticeModel model = LATTICE_CRR);
+private:
+    typedef std::list<std::pair<LatticeKey, std::shared_ptr<const Lattice> > >
+        LatticeList;
+
+    size_t capacity;
+    std::mutex mutex;
+    // Most recently used first
+    LatticeList lattices;
+    std::map<LatticeKey, LatticeList::iterator> index;
+};
+#endif
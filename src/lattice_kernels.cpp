@@ -0,0 +1,261 @@
+#include <cmath>
+#include <algorithm>
+
+#include "lattice_kernels.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LATTICE_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+static void backwardInductionScalar(double* optionValue, int numNodes,
+                                    double upWeight, double downWeight) {
+    for (int j = 0; j < numNodes; j++) {
+        optionValue[j] = downWeight * optionValue[j] +
+                         upWeight * optionValue[j + 1];
+    }
+}
+
+static void trinomialInductionScalar(double* optionValue, int numNodes,
+                                    double upWeight, double middleWeight,
+                                    double downWeight) {
+    for (int j = 0; j < numNodes; j++) {
+        optionValue[j] = downWeight * optionValue[j] +
+                         middleWeight * optionValue[j + 1] +
+                         upWeight * optionValue[j + 2];
+    }
+}
+
+static void exerciseValueScalar(double* optionValue, const double* nodePrice,
+                                int numNodes, int type, double strikePrice) {
+    for (int j = 0; j < numNodes; j++) {
+        optionValue[j] = std::max(optionValue[j],
+                                  type * (nodePrice[j] - strikePrice));
+    }
+}
+
+#ifdef LATTICE_KERNELS_X86
+// NOTE(disiok): Storing lanes [j, j + width) only after loading [j, j + width]
+// keeps the in-place update correct, the next iteration reads from j + width
+
+__attribute__((target("avx2,fma")))
+static void backwardInductionAVX2(double* optionValue, int numNodes,
+                                  double upWeight, double downWeight) {
+    __m256d up = _mm256_set1_pd(upWeight);
+    __m256d down = _mm256_set1_pd(downWeight);
+    int j = 0;
+    for (; j + 8 <= numNodes; j += 8) {
+        __m256d downValue0 = _mm256_loadu_pd(optionValue + j);
+        __m256d upValue0 = _mm256_loadu_pd(optionValue + j + 1);
+        __m256d downValue1 = _mm256_loadu_pd(optionValue + j + 4);
+        __m256d upValue1 = _mm256_loadu_pd(optionValue + j + 5);
+        _mm256_storeu_pd(optionValue + j,
+                _mm256_fmadd_pd(down, downValue0, _mm256_mul_pd(up, upValue0)));
+        _mm256_storeu_pd(optionValue + j + 4,
+                _mm256_fmadd_pd(down, downValue1, _mm256_mul_pd(up, upValue1)));
+    }
+    for (; j + 4 <= numNodes; j += 4) {
+        __m256d downValue = _mm256_loadu_pd(optionValue + j);
+        __m256d upValue = _mm256_loadu_pd(optionValue + j + 1);
+        _mm256_storeu_pd(optionValue + j,
+                _mm256_fmadd_pd(down, downValue, _mm256_mul_pd(up, upValue)));
+    }
+    backwardInductionScalar(optionValue + j, numNodes - j, upWeight, downWeight);
+}
+
+__attribute__((target("avx2,fma")))
+static void trinomialInductionAVX2(double* optionValue, int numNodes,
+                                   double upWeight, double middleWeight,
+                                   double downWeight) {
+    __m256d up = _mm256_set1_pd(upWeight);
+    __m256d middle = _mm256_set1_pd(middleWeight);
+    __m256d down = _mm256_set1_pd(downWeight);
+    int j = 0;
+    for (; j + 4 <= numNodes; j += 4) {
+        __m256d downValue = _mm256_loadu_pd(optionValue + j);
+        __m256d middleValue = _mm256_loadu_pd(optionValue + j + 1);
+        __m256d upValue = _mm256_loadu_pd(optionValue + j + 2);
+        _mm256_storeu_pd(optionValue + j,
+                _mm256_fmadd_pd(down, downValue,
+                        _mm256_fmadd_pd(middle, middleValue,
+                                        _mm256_mul_pd(up, upValue))));
+    }
+    trinomialInductionScalar(optionValue + j, numNodes - j, upWeight,
+                             middleWeight, downWeight);
+}
+
+__attribute__((target("avx2,fma")))
+static void exerciseValueAVX2(double* optionValue, const double* nodePrice,
+                              int numNodes, int type, double strikePrice) {
+    __m256d sign = _mm256_set1_pd(type);
+    __m256d strike = _mm256_set1_pd(strikePrice);
+    int j = 0;
+    for (; j + 4 <= numNodes; j += 4) {
+        __m256d payoff = _mm256_mul_pd(sign,
+                _mm256_sub_pd(_mm256_loadu_pd(nodePrice + j), strike));
+        _mm256_storeu_pd(optionValue + j,
+                _mm256_max_pd(_mm256_loadu_pd(optionValue + j), payoff));
+    }
+    exerciseValueScalar(optionValue + j, nodePrice + j, numNodes - j,
+                        type, strikePrice);
+}
+
+__attribute__((target("avx512f")))
+static void backwardInductionAVX512(double* optionValue, int numNodes,
+                                    double upWeight, double downWeight) {
+    __m512d up = _mm512_set1_pd(upWeight);
+    __m512d down = _mm512_set1_pd(downWeight);
+    int j = 0;
+    for (; j + 16 <= numNodes; j += 16) {
+        __m512d downValue0 = _mm512_loadu_pd(optionValue + j);
+        __m512d upValue0 = _mm512_loadu_pd(optionValue + j + 1);
+        __m512d downValue1 = _mm512_loadu_pd(optionValue + j + 8);
+        __m512d upValue1 = _mm512_loadu_pd(optionValue + j + 9);
+        _mm512_storeu_pd(optionValue + j,
+                _mm512_fmadd_pd(down, downValue0, _mm512_mul_pd(up, upValue0)));
+        _mm512_storeu_pd(optionValue + j + 8,
+                _mm512_fmadd_pd(down, downValue1, _mm512_mul_pd(up, upValue1)));
+    }
+    for (; j + 8 <= numNodes; j += 8) {
+        __m512d downValue = _mm512_loadu_pd(optionValue + j);
+        __m512d upValue = _mm512_loadu_pd(optionValue + j + 1);
+        _mm512_storeu_pd(optionValue + j,
+                _mm512_fmadd_pd(down, downValue, _mm512_mul_pd(up, upValue)));
+    }
+    backwardInductionScalar(optionValue + j, numNodes - j, upWeight, downWeight);
+}
+
+__attribute__((target("avx512f")))
+static void exerciseValueAVX512(double* optionValue, const double* nodePrice,
+                                int numNodes, int type, double strikePrice) {
+    __m512d sign = _mm512_set1_pd(type);
+    __m512d strike = _mm512_set1_pd(strikePrice);
+    int j = 0;
+    for (; j + 8 <= numNodes; j += 8) {
+        __m512d payoff = _mm512_mul_pd(sign,
+                _mm512_sub_pd(_mm512_loadu_pd(nodePrice + j), strike));
+        // NOTE(disiok): Full-mask maskz form, GCC warns on the undefined
+        // passthrough operand of _mm512_max_pd
+        _mm512_storeu_pd(optionValue + j,
+                _mm512_maskz_max_pd(0xFF, _mm512_loadu_pd(optionValue + j),
+                                    payoff));
+    }
+    exerciseValueScalar(optionValue + j, nodePrice + j, numNodes - j,
+                        type, strikePrice);
+}
+#endif
+
+SimdLevel detectSimdLevel() {
+#ifdef LATTICE_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return SIMD_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return SIMD_AVX2;
+    }
+#endif
+    return SIMD_SCALAR;
+}
+
+typedef void (*BackwardInductionFn)(double*, int, double, double);
+typedef void (*TrinomialInductionFn)(double*, int, double, double, double);
+typedef void (*ExerciseValueFn)(double*, const double*, int, int, double);
+
+static BackwardInductionFn selectBackwardInduction(SimdLevel level) {
+#ifdef LATTICE_KERNELS_X86
+    if (level == SIMD_AVX512) {
+        return backwardInductionAVX512;
+    }
+    if (level == SIMD_AVX2) {
+        return backwardInductionAVX2;
+    }
+#endif
+    return backwardInductionScalar;
+}
+
+// AVX-512 machines run the AVX2 variant
+static TrinomialInductionFn selectTrinomialInduction(SimdLevel level) {
+#ifdef LATTICE_KERNELS_X86
+    if (level >= SIMD_AVX2) {
+        return trinomialInductionAVX2;
+    }
+#endif
+    return trinomialInductionScalar;
+}
+
+static ExerciseValueFn selectExerciseValue(SimdLevel level) {
+#ifdef LATTICE_KERNELS_X86
+    if (level == SIMD_AVX512) {
+        return exerciseValueAVX512;
+    }
+    if (level == SIMD_AVX2) {
+        return exerciseValueAVX2;
+    }
+#endif
+    return exerciseValueScalar;
+}
+
+static SimdLevel currentLevel = detectSimdLevel();
+static BackwardInductionFn currentBackwardInduction =
+    selectBackwardInduction(currentLevel);
+static TrinomialInductionFn currentTrinomialInduction =
+    selectTrinomialInduction(currentLevel);
+static ExerciseValueFn currentExerciseValue = selectExerciseValue(currentLevel);
+
+SimdLevel simdLevel() {
+    return currentLevel;
+}
+
+void setSimdLevel(SimdLevel level) {
+    if (level > detectSimdLevel()) {
+        level = detectSimdLevel();
+    }
+    currentLevel = level;
+    currentBackwardInduction = selectBackwardInduction(level);
+    currentTrinomialInduction = selectTrinomialInduction(level);
+    currentExerciseValue = selectExerciseValue(level);
+}
+
+void backwardInduction(double* optionValue, int numNodes,
+                       double upWeight, double downWeight) {
+    currentBackwardInduction(optionValue, numNodes, upWeight, downWeight);
+}
+
+void trinomialInduction(double* optionValue, int numNodes, double upWeight,
+                        double middleWeight, double downWeight) {
+    currentTrinomialInduction(optionValue, numNodes, upWeight, middleWeight,
+                              downWeight);
+}
+
+void exerciseValue(double* optionValue, const double* nodePrice, int numNodes,
+                   int type, double strikePrice) {
+    currentExerciseValue(optionValue, nodePrice, numNodes, type, strikePrice);
+}
+
+void powerTable(double* powers, double base, int n) {
+    for (int k = 0; k <= n; k++) {
+        powers[k] = k % NODE_PRICE_ANCHOR == 0 ? pow(base, k)
+                                               : powers[k - 1] * base;
+    }
+}
+
+void nodePrices(double* nodePrice, double stockPrice, double upFactor,
+                double downFactor, int step, int index, int numNodes) {
+    double ratio = upFactor / downFactor;
+    for (int j = 0; j < numNodes; j++) {
+        if (j % NODE_PRICE_ANCHOR == 0) {
+            nodePrice[j] = stockPrice * pow(upFactor, index + j) *
+                           pow(downFactor, step - index - j);
+        } else {
+            nodePrice[j] = nodePrice[j - 1] * ratio;
+        }
+    }
+}
+
+void previousNodePrices(double* nodePrice, int numNodes, double downFactor) {
+    double factor = 1.0 / downFactor;
+    for (int j = 0; j < numNodes; j++) {
+        nodePrice[j] *= factor;
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef __LATTICE_KERNELS_H__
+#define __LATTICE_KERNELS_H__
+
+// Instruction sets the CPU lattice kernels can be dispatched to
+enum SimdLevel {
+    SIMD_SCALAR = 0,
+    SIMD_AVX2 = 1,
+    SIMD_AVX512 = 2
+};
+
+// Best instruction set supported by the running CPU
+SimdLevel detectSimdLevel();
+
+// Instruction set currently used by backwardInduction
+SimdLevel simdLevel();
+
+// Overrides the dispatch, clamped to what the running CPU supports
+void setSimdLevel(SimdLevel level);
+
+/**
+ * Iterates numNodes lattice points backwards by one time-step in place:
+ *      optionValue[j] = downWeight * optionValue[j] + upWeight * optionValue[j + 1]
+ * Reads numNodes + 1 points. Weights must already include the discounting.
+ */
+void backwardInduction(double* optionValue, int numNodes,
+                       double upWeight, double downWeight);
+
+/**
+ * Iterates numNodes trinomial lattice points backwards by one time-step in
+ * place:
+ *      optionValue[j] = downWeight * optionValue[j] +
+ *                       middleWeight * optionValue[j + 1] +
+ *                       upWeight * optionValue[j + 2]
+ * Reads numNodes + 2 points. Weights must already include the discounting.
+ */
+void trinomialInduction(double* optionValue, int numNodes, double upWeight,
+                        double middleWeight, double downWeight);
+
+/**
+ * Applies early exercise to numNodes lattice points:
+ *      optionValue[j] = max(optionValue[j], type * (nodePrice[j] - strikePrice))
+ */
+void exerciseValue(double* optionValue, const double* nodePrice, int numNodes,
+                   int type, double strikePrice);
+
+// Node price generators are re-anchored with pow() every this many terms
+#define NODE_PRICE_ANCHOR 64
+
+/**
+ * Fills powers[k] = base^k for k = 0..n by repeated multiplication,
+ * re-anchored every NODE_PRICE_ANCHOR terms to bound the rounding error
+ */
+void powerTable(double* powers, double base, int n);
+
+/**
+ * Fills nodePrice[j] with the stock price at lattice node (index + j) of the
+ * given time-step for j = 0..numNodes - 1:
+ *      stockPrice * upFactor^(index + j) * downFactor^(step - index - j)
+ * Neighbouring nodes differ by upFactor / downFactor, so only one node in
+ * every NODE_PRICE_ANCHOR is computed with pow()
+ */
+void nodePrices(double* nodePrice, double stockPrice, double upFactor,
+                double downFactor, int step, int index, int numNodes);
+
+/**
+ * Moves numNodes node prices one time-step back towards the root, each
+ * node keeps its index so its price is divided by downFactor
+ */
+void previousNodePrices(double* nodePrice, int numNodes, double downFactor);
+#endif
@@ -0,0 +1,137 @@
+#include <vector>
+#include <algorithm>
+
+#include "option_spec.h"
+#include "option_batch.h"
+#include "pricer.h"
+
+LatticePricer::LatticePricer(): convergenceMode(CONVERGENCE_PLAIN),
+                                latticeModel(LATTICE_CRR) {
+}
+
+void LatticePricer::setConvergenceMode(ConvergenceMode mode) {
+    convergenceMode = mode;
+}
+
+void LatticePricer::setLatticeModel(LatticeModel model) {
+    latticeModel = model;
+}
+
+/**
+ * Odd Leisen-Reimer lattices already centre the strike between the nodes
+ * at expiry. Black-Scholes values of the last time-step are smooth in the
+ * stock price, which Peizer-Pratt inversion only matches to O(1/N), so
+ * Leisen-Reimer lattices are never shortened
+ */
+bool LatticePricer::isSmoothed() const {
+    return convergenceMode != CONVERGENCE_PLAIN &&
+           latticeModel != LATTICE_LEISEN_REIMER;
+}
+
+/**
+ * Discrete dividends after maturity are dropped before the maturity is
+ * shortened, so that the lattice still escrows those paid in the last
+ * time-step
+ */
+OptionSpec LatticePricer::latticeSpec(const OptionSpec& optionSpec) const {
+    OptionSpec spec = optionSpec;
+    if (optionSpec.numDividends > 0) {
+        spec = dividendsToMaturity(optionSpec);
+    }
+    if (!isSmoothed()) {
+        spec.numSteps = latticeSteps(latticeModel, optionSpec.numSteps);
+        return spec;
+    }
+    int numSteps = std::max(optionSpec.numSteps, 2);
+    spec.numSteps = numSteps - 1;
+    spec.yearsToMaturity = optionSpec.yearsToMaturity * (numSteps - 1) /
+                           numSteps;
+    return spec;
+}
+
+// Coarse lattice of the Richardson extrapolation of optionSpec
+static OptionSpec coarseSpec(const OptionSpec& optionSpec) {
+    OptionSpec spec = optionSpec;
+    spec.numSteps = optionSpec.numSteps / 2;
+    return spec;
+}
+
+// Richardson extrapolation needs a coarse lattice of at least 2 time-steps
+static bool isExtrapolated(ConvergenceMode mode, int numSteps) {
+    return mode == CONVERGENCE_BBSR && numSteps >= 4;
+}
+
+/**
+ * Richardson extrapolation of the prices of lattices of fineSteps and
+ * coarseSteps time-steps. BBS errors fall as 1/N, those of Leisen-Reimer as
+ * 1/N^2 over lattices that are not quite twice as fine once rounded to odd
+ */
+double LatticePricer::extrapolate(double finePrice, int fineSteps,
+                                  double coarsePrice, int coarseSteps) const {
+    if (latticeModel != LATTICE_LEISEN_REIMER) {
+        return 2 * finePrice - coarsePrice;
+    }
+    double fineWeight = (double) fineSteps * fineSteps;
+    double coarseWeight = (double) coarseSteps * coarseSteps;
+    return (fineWeight * finePrice - coarseWeight * coarsePrice) /
+           (fineWeight - coarseWeight);
+}
+
+double LatticePricer::price(OptionSpec& optionSpec) {
+    OptionSpec fineSpec = latticeSpec(optionSpec);
+    double finePrice = priceLattice(fineSpec);
+    if (!isExtrapolated(convergenceMode, optionSpec.numSteps)) {
+        return finePrice;
+    }
+    OptionSpec spec = latticeSpec(coarseSpec(optionSpec));
+    return extrapolate(finePrice, fineSpec.numSteps, priceLattice(spec),
+                       spec.numSteps);
+}
+
+// True when an option of optionBatch has discrete dividends
+static bool hasDividends(const OptionBatch& optionBatch) {
+    for (size_t i = 0; i < optionBatch.size(); i ++) {
+        if (optionBatch.numDividends[i] > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Coarse lattices of BBSR are appended to the fine ones, so that the
+ * pricer sees a single batch
+ */
+void LatticePricer::price(const OptionBatch& optionBatch,
+                          std::vector<double>& prices) {
+    if (!isSmoothed() && !hasDividends(optionBatch) &&
+        latticeModel != LATTICE_LEISEN_REIMER) {
+        priceLattice(optionBatch, prices);
+        return;
+    }
+
+    OptionBatch latticeBatch;
+    std::vector<size_t> extrapolated;
+    latticeBatch.reserve(optionBatch.size());
+    for (size_t i = 0; i < optionBatch.size(); i ++) {
+        latticeBatch.push_back(latticeSpec(optionBatch[i]));
+    }
+    for (size_t i = 0; i < optionBatch.size(); i ++) {
+        if (isExtrapolated(convergenceMode, optionBatch.numSteps[i])) {
+            latticeBatch.push_back(latticeSpec(coarseSpec(optionBatch[i])));
+            extrapolated.push_back(i);
+        }
+    }
+
+    std::vector<double> latticePrices;
+    priceLattice(latticeBatch, latticePrices);
+    prices.assign(latticePrices.begin(),
+                  latticePrices.begin() + optionBatch.size());
+    for (size_t k = 0; k < extrapolated.size(); k ++) {
+        size_t i = extrapolated[k];
+        size_t coarse = optionBatch.size() + k;
+        prices[i] = extrapolate(prices[i], latticeBatch.numSteps[i],
+                                latticePrices[coarse],
+                                latticeBatch.numSteps[coarse]);
+    }
+}
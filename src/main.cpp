@@ -1,15 +1,29 @@
 #include <iostream>
 #include <iomanip>
 #include <chrono>
+#include <vector>
+#include <cmath>
 #include "option_spec.h"
+#include "option_batch.h"
 #include "pricer.h"
+#include "pricer_factory.h"
+#include "black_scholes.h"
 
 void iterativeBenchmark(int initialNumSteps, int growthRate, int seconds) {
     auto start = std::chrono::steady_clock::now();
     std::chrono::seconds maxDuration(seconds);
 
     OptionPricer* serialPricer = new SerialPricer(); 
-    OptionPricer* openclPricer = new OpenCLPricer();
+    OptionPricer* parallelPricer = new ParallelPricer();
+#ifndef PRICER_CPU_ONLY
+    // Device selection is read from the environment, see createPricer
+    PricerConfig config = pricerConfigFromEnvironment();
+    config.backend = "opencl";
+    config.precision = PRECISION_SINGLE;
+    OptionPricer* openclPricer = createPricer(config);
+    config.precision = PRECISION_DOUBLE;
+    OptionPricer* openclDoublePricer = createPricer(config);
+#endif
     while (std::chrono::steady_clock::now() - start < maxDuration) {
         std::cout << "-------------------------------------" << std::endl;
 
@@ -26,6 +40,16 @@ void iterativeBenchmark(int initialNumSteps, int growthRate, int seconds) {
         std::cout << "[Benchmark] Time: " << std::chrono::duration<double, std::milli> (diff).count()
             << " ms" << std::endl;
 
+        // Price with parallel pricer
+        start = std::chrono::steady_clock::now();
+        double parallelPrice = parallelPricer->price(optionSpec);
+        end = std::chrono::steady_clock::now();
+        diff = end - start;
+        std::cout << "[Parallel] Value: " << std::setprecision(10) << parallelPrice << std::endl;
+        std::cout << "[Parallel] Time: " << std::chrono::duration<double, std::milli> (diff).count()
+            << " ms" << std::endl;
+
+#ifndef PRICER_CPU_ONLY
         // Price with opencl pricer
         start = std::chrono::steady_clock::now();
         double openclPrice = openclPricer->price(optionSpec); 
@@ -35,15 +59,463 @@ void iterativeBenchmark(int initialNumSteps, int growthRate, int seconds) {
         std::cout << "[OpenCL] Time: "  << std::chrono::duration<double, std::milli> (diff).count()
             << " ms" << std::endl;
 
+        // Price with double precision opencl pricer
+        start = std::chrono::steady_clock::now();
+        double openclDoublePrice = openclDoublePricer->price(optionSpec); 
+        end = std::chrono::steady_clock::now();
+        diff = end - start;
+        std::cout << "[OpenCL fp64] Value: " << std::setprecision(10) << openclDoublePrice << std::endl; 
+        std::cout << "[OpenCL fp64] Time: "  << std::chrono::duration<double, std::milli> (diff).count()
+            << " ms" << std::endl;
+#endif
+
         initialNumSteps *= growthRate;
     }
+
+    delete serialPricer;
+    delete parallelPricer;
+#ifndef PRICER_CPU_ONLY
+    delete openclPricer;
+    delete openclDoublePricer;
+#endif
+}
+
+void batchBenchmark(int numOptions, int numSteps) {
+    OptionPricer* serialPricer = new SerialPricer();
+    OptionPricer* parallelPricer = new ParallelPricer();
+#ifndef PRICER_CPU_ONLY
+    PricerConfig config = pricerConfigFromEnvironment();
+    config.backend = "opencl";
+    OptionPricer* openclPricer = createPricer(config);
+#endif
+    std::cout << "-------------------------------------" << std::endl;
+    std::cout << "Number of options: " << numOptions
+        << ", Number of steps: " << numSteps << std::endl;
+
+    // Construct test book with a ladder of call and put strikes
+    std::vector<OptionSpec> optionSpecs;
+    for (int i = 0; i < numOptions; i ++) {
+        int type = i % 2 == 0 ? 1 : -1;
+        float strikePrice = 80 + 40.0f * i / numOptions;
+        OptionSpec optionSpec = {type, 100, strikePrice, 1.0, 0.3, 0.02, numSteps, false};
+        optionSpecs.push_back(optionSpec);
+    }
+    // Laid out in columns once, outside the timed pricing calls
+    OptionBatch optionBatch(optionSpecs);
+
+    // Price with serial pricer
+    std::vector<double> benchmarkPrices;
+    auto start = std::chrono::steady_clock::now();
+    serialPricer->price(optionBatch, benchmarkPrices);
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "[Benchmark] Batch Time: "
+        << std::chrono::duration<double, std::milli> (end - start).count()
+        << " ms" << std::endl;
+
+    // Price with parallel pricer
+    std::vector<double> parallelPrices;
+    start = std::chrono::steady_clock::now();
+    parallelPricer->price(optionBatch, parallelPrices);
+    end = std::chrono::steady_clock::now();
+    std::cout << "[Parallel] Batch Time: "
+        << std::chrono::duration<double, std::milli> (end - start).count()
+        << " ms" << std::endl;
+
+#ifndef PRICER_CPU_ONLY
+    // Price with opencl pricer
+    std::vector<double> openclPrices;
+    start = std::chrono::steady_clock::now();
+    openclPricer->price(optionBatch, openclPrices);
+    end = std::chrono::steady_clock::now();
+    std::cout << "[OpenCL] Batch Time: "
+        << std::chrono::duration<double, std::milli> (end - start).count()
+        << " ms" << std::endl;
+
+    double maxError = 0;
+    for (int i = 0; i < numOptions; i ++) {
+        maxError = std::max(maxError, std::abs(benchmarkPrices[i] - openclPrices[i]));
+    }
+    std::cout << "[OpenCL] Batch Max Error: " << maxError << std::endl;
+    delete openclPricer;
+#endif
+
+    delete serialPricer;
+    delete parallelPricer;
+}
+
+void asyncBenchmark(int numOptions, int numSteps) {
+    OptionPricer* pricer = createPricer(pricerConfigFromEnvironment());
+    if (pricer == NULL) {
+        return;
+    }
+    std::cout << "-------------------------------------" << std::endl;
+    std::cout << "Number of options: " << numOptions
+        << ", Number of steps: " << numSteps << std::endl;
+
+    std::vector<OptionSpec> optionSpecs;
+    for (int i = 0; i < numOptions; i ++) {
+        int type = i % 2 == 0 ? 1 : -1;
+        float strikePrice = 80 + 40.0f * i / numOptions;
+        OptionSpec optionSpec = {type, 100, strikePrice, 1.0, 0.3, 0.02, numSteps, false};
+        optionSpecs.push_back(optionSpec);
+    }
+
+    // Price one option at a time, waiting for each
+    std::vector<double> syncPrices;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < numOptions; i ++) {
+        syncPrices.push_back(pricer->price(optionSpecs[i]));
+    }
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "[Sync] Time: "
+        << std::chrono::duration<double, std::milli> (end - start).count()
+        << " ms" << std::endl;
+
+    // Start every option before waiting for the first
+    std::vector<std::future<double> > futures;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < numOptions; i ++) {
+        futures.push_back(pricer->priceAsync(optionSpecs[i]));
+    }
+    double maxError = 0;
+    for (int i = 0; i < numOptions; i ++) {
+        maxError = std::max(maxError, std::abs(futures[i].get() - syncPrices[i]));
+    }
+    end = std::chrono::steady_clock::now();
+    std::cout << "[Async] Time: "
+        << std::chrono::duration<double, std::milli> (end - start).count()
+        << " ms" << std::endl;
+    std::cout << "[Async] Max Error: " << maxError << std::endl;
+
+    delete pricer;
+}
+
+void ladderBenchmark(int numStrikes, int numSteps) {
+    OptionPricer* pricer = createPricer(pricerConfigFromEnvironment());
+    if (pricer == NULL) {
+        return;
+    }
+    std::cout << "-------------------------------------" << std::endl;
+    std::cout << "Number of strikes: " << numStrikes
+        << ", Number of steps: " << numSteps << std::endl;
+
+    OptionSpec optionSpec = {-1, 100, 100, 1.0, 0.3, 0.02, numSteps, true};
+    std::vector<float> strikePrices;
+    for (int i = 0; i < numStrikes; i ++) {
+        strikePrices.push_back(80 + 40.0f * i / numStrikes);
+    }
+
+    // Price one strike at a time, each sweeping the lattice
+    std::vector<double> strikeByStrikePrices;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < numStrikes; i ++) {
+        OptionSpec strikeSpec = optionSpec;
+        strikeSpec.strikePrice = strikePrices[i];
+        strikeByStrikePrices.push_back(pricer->price(strikeSpec));
+    }
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "[Strike by strike] Time: "
+        << std::chrono::duration<double, std::milli> (end - start).count()
+        << " ms" << std::endl;
+
+    // Price every strike in one sweep of the lattice
+    std::vector<double> ladderPrices;
+    start = std::chrono::steady_clock::now();
+    pricer->priceLadder(optionSpec, strikePrices, ladderPrices);
+    end = std::chrono::steady_clock::now();
+    std::cout << "[Ladder] Time: "
+        << std::chrono::duration<double, std::milli> (end - start).count()
+        << " ms" << std::endl;
+
+    double maxError = 0;
+    for (int i = 0; i < numStrikes; i ++) {
+        maxError = std::max(maxError,
+                            std::abs(ladderPrices[i] - strikeByStrikePrices[i]));
+    }
+    std::cout << "[Ladder] Max Error: " << maxError << std::endl;
+
+    delete pricer;
+}
+
+void greeksBenchmark(int numSteps) {
+    OptionPricer* pricer = createPricer(pricerConfigFromEnvironment());
+    if (pricer == NULL) {
+        return;
+    }
+    std::cout << "-------------------------------------" << std::endl;
+    std::cout << "Number of steps: " << numSteps << std::endl;
+
+    OptionSpec optionSpec = {-1, 100, 100, 1.0, 0.3, 0.02, numSteps, true};
+
+    // Bump and reprice, as OptionPricer does by default
+    auto start = std::chrono::steady_clock::now();
+    OptionGreeks bumpedGreeks = pricer->OptionPricer::priceWithGreeks(optionSpec);
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "[Bumped] Time: "
+        << std::chrono::duration<double, std::milli> (end - start).count()
+        << " ms, Delta: " << bumpedGreeks.delta
+        << ", Gamma: " << bumpedGreeks.gamma
+        << ", Theta: " << bumpedGreeks.theta << std::endl;
+
+    // Read off the nodes near the root of a single lattice walk
+    start = std::chrono::steady_clock::now();
+    OptionGreeks greeks = pricer->priceWithGreeks(optionSpec);
+    end = std::chrono::steady_clock::now();
+    std::cout << "[Lattice] Time: "
+        << std::chrono::duration<double, std::milli> (end - start).count()
+        << " ms, Delta: " << greeks.delta
+        << ", Gamma: " << greeks.gamma
+        << ", Theta: " << greeks.theta << std::endl;
+
+    delete pricer;
+}
+
+void impliedVolatilityBenchmark(int numOptions, int numSteps) {
+    OptionPricer* pricer = createPricer(pricerConfigFromEnvironment());
+    if (pricer == NULL) {
+        return;
+    }
+    std::cout << "-------------------------------------" << std::endl;
+    std::cout << "Number of options: " << numOptions
+        << ", Number of steps: " << numSteps << std::endl;
+
+    // Market prices of a smile across strikes, from the serial pricer
+    SerialPricer serialPricer;
+    std::vector<OptionSpec> optionSpecs;
+    std::vector<double> marketPrices;
+    std::vector<double> trueVolatilities;
+    for (int i = 0; i < numOptions; i ++) {
+        int type = i % 2 == 0 ? 1 : -1;
+        float strikePrice = 80 + 40.0f * i / numOptions;
+        float volatility = 0.2f + 0.1f * std::abs(strikePrice - 100) / 20;
+        OptionSpec optionSpec = {type, 100, strikePrice, 1.0, volatility, 0.02, numSteps, true};
+        optionSpecs.push_back(optionSpec);
+        marketPrices.push_back(serialPricer.price(optionSpec));
+        trueVolatilities.push_back(volatility);
+    }
+    OptionBatch optionBatch(optionSpecs);
+
+    std::vector<double> volatilities;
+    auto start = std::chrono::steady_clock::now();
+    pricer->impliedVolatility(optionBatch, marketPrices, volatilities);
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "[Implied Volatility] Time: "
+        << std::chrono::duration<double, std::milli> (end - start).count()
+        << " ms" << std::endl;
+
+    double maxError = 0;
+    for (int i = 0; i < numOptions; i ++) {
+        maxError = std::max(maxError,
+                            std::abs(volatilities[i] - trueVolatilities[i]));
+    }
+    std::cout << "[Implied Volatility] Max Error: " << maxError << std::endl;
+
+    delete pricer;
+}
+
+void routingBenchmark(int numOptions, int numSteps) {
+    OptionPricer* latticePricer = createPricer(pricerConfigFromEnvironment());
+    if (latticePricer == NULL) {
+        return;
+    }
+    PricerConfig config = pricerConfigFromEnvironment();
+    config.routeEuropean = true;
+    RoutingPricer* routingPricer =
+        dynamic_cast<RoutingPricer*>(createPricer(config));
+    if (routingPricer == NULL) {
+        delete latticePricer;
+        return;
+    }
+    routingPricer->setValidation(numSteps, 1e-1);
+    std::cout << "-------------------------------------" << std::endl;
+    std::cout << "Number of options: " << numOptions
+        << ", Number of steps: " << numSteps << std::endl;
+
+    // Book of mostly European options
+    std::vector<OptionSpec> optionSpecs;
+    for (int i = 0; i < numOptions; i ++) {
+        int type = i % 2 == 0 ? 1 : -1;
+        float strikePrice = 80 + 40.0f * i / numOptions;
+        OptionSpec optionSpec = {type, 100, strikePrice, 1.0, 0.3, 0.02, numSteps, i % 4 == 0};
+        optionSpecs.push_back(optionSpec);
+    }
+    OptionBatch optionBatch(optionSpecs);
+
+    std::vector<double> latticePrices;
+    auto start = std::chrono::steady_clock::now();
+    latticePricer->price(optionBatch, latticePrices);
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "[Lattice] Batch Time: "
+        << std::chrono::duration<double, std::milli> (end - start).count()
+        << " ms" << std::endl;
+
+    // Validation prices the European options on the lattice as well
+    std::vector<double> routedPrices;
+    start = std::chrono::steady_clock::now();
+    routingPricer->price(optionBatch, routedPrices);
+    end = std::chrono::steady_clock::now();
+    std::cout << "[Routed] Batch Time: "
+        << std::chrono::duration<double, std::milli> (end - start).count()
+        << " ms, Validation Error: " << routingPricer->maxValidationError()
+        << std::endl;
+
+    routingPricer->setValidation(0, 0);
+    start = std::chrono::steady_clock::now();
+    routingPricer->price(optionBatch, routedPrices);
+    end = std::chrono::steady_clock::now();
+    std::cout << "[Routed] Batch Time without validation: "
+        << std::chrono::duration<double, std::milli> (end - start).count()
+        << " ms" << std::endl;
+
+    delete routingPricer;
+    delete latticePricer;
+}
+
+void convergenceBenchmark(int maxNumSteps) {
+    OptionPricer* pricer = createPricer(pricerConfigFromEnvironment());
+    LatticePricer* latticePricer = dynamic_cast<LatticePricer*>(pricer);
+    if (latticePricer == NULL) {
+        delete pricer;
+        return;
+    }
+    const char* names[] = {"Plain", "BBS", "BBSR"};
+    ConvergenceMode modes[] = {CONVERGENCE_PLAIN, CONVERGENCE_BBS,
+                               CONVERGENCE_BBSR};
+
+    // European put, whose Black-Scholes price is the limit of every mode
+    for (int numSteps = 25; numSteps <= maxNumSteps; numSteps *= 2) {
+        std::cout << "-------------------------------------" << std::endl;
+        std::cout << "Number of steps: " << numSteps << std::endl;
+        OptionSpec optionSpec = {-1, 100, 105, 1.0, 0.3, 0.02, numSteps, false};
+        double referencePrice = blackScholesPrice(optionSpec);
+        for (int i = 0; i < 3; i ++) {
+            latticePricer->setConvergenceMode(modes[i]);
+            auto start = std::chrono::steady_clock::now();
+            double price = latticePricer->price(optionSpec);
+            auto end = std::chrono::steady_clock::now();
+            std::cout << "[" << names[i] << "] Error: "
+                << std::fabs(price - referencePrice) << ", Time: "
+                << std::chrono::duration<double, std::milli> (end - start).count()
+                << " ms" << std::endl;
+        }
+    }
+
+    delete pricer;
+}
+
+void latticeModelBenchmark(int numSteps) {
+    OptionPricer* pricer = createPricer(pricerConfigFromEnvironment());
+    LatticePricer* latticePricer = dynamic_cast<LatticePricer*>(pricer);
+    if (latticePricer == NULL) {
+        delete pricer;
+        return;
+    }
+    std::cout << "-------------------------------------" << std::endl;
+    std::cout << "Number of steps: " << numSteps << std::endl;
+
+    // European put against its Black-Scholes price
+    OptionSpec optionSpec = {-1, 100, 105, 1.0, 0.3, 0.02, numSteps, false};
+    double referencePrice = blackScholesPrice(optionSpec);
+    const char* names[] = {"CRR", "Jarrow-Rudd", "Tian", "Leisen-Reimer",
+                           "Trinomial"};
+    for (int i = 0; i < 5; i ++) {
+        latticePricer->setLatticeModel((LatticeModel) i);
+        auto start = std::chrono::steady_clock::now();
+        double price = latticePricer->price(optionSpec);
+        auto end = std::chrono::steady_clock::now();
+        std::cout << "[" << names[i] << "] Error: "
+            << std::fabs(price - referencePrice) << ", Time: "
+            << std::chrono::duration<double, std::milli> (end - start).count()
+            << " ms" << std::endl;
+    }
+
+    delete pricer;
+}
+
+void dividendBenchmark(int numSteps) {
+    OptionPricer* pricer = createPricer(pricerConfigFromEnvironment());
+    if (pricer == NULL) {
+        return;
+    }
+    std::cout << "-------------------------------------" << std::endl;
+    std::cout << "Number of steps: " << numSteps << std::endl;
+
+    // Put with a 1% yield and two cash dividends, the European against its
+    // Black-Scholes price on the escrowed stock price
+    OptionSpec optionSpec(-1, 100, 105, 1.0, 0.3, 0.02, numSteps, false,
+                          0.01f);
+    optionSpec.addDividend(0.25f, 1.5f);
+    optionSpec.addDividend(0.75f, 1.5f);
+    double referencePrice = blackScholesPrice(optionSpec);
+    const char* names[] = {"European", "American"};
+    for (int i = 0; i < 2; i ++) {
+        optionSpec.isAmerican = i == 1;
+        auto start = std::chrono::steady_clock::now();
+        double price = pricer->price(optionSpec);
+        auto end = std::chrono::steady_clock::now();
+        std::cout << "[" << names[i] << "] Price: " << price
+            << ", Black-Scholes: " << referencePrice << ", Time: "
+            << std::chrono::duration<double, std::milli> (end - start).count()
+            << " ms" << std::endl;
+    }
+
+    delete pricer;
+}
+
+#ifndef PRICER_CPU_ONLY
+void algorithmBenchmark(int numSteps) {
+    PricerConfig config = pricerConfigFromEnvironment();
+    config.backend = "opencl";
+    OptionPricer* pricer = createPricer(config);
+    OpenCLPricer* openclPricer = dynamic_cast<OpenCLPricer*>(pricer);
+    if (openclPricer == NULL) {
+        delete pricer;
+        return;
+    }
+    std::cout << "-------------------------------------" << std::endl;
+    std::cout << "Number of steps: " << numSteps << std::endl;
+
+    OptionSpec optionSpec = {-1, 100, 100, 1.0, 0.3, 0.02, numSteps, true};
+    double benchmarkPrice = SerialPricer().price(optionSpec);
+
+    // Launches per option: numSteps, 2 * numSteps / stepSize and
+    // numSteps / stepsPerLaunch
+    const char* names[] = {"Group", "Triangle", "Trapezoid"};
+    LatticeAlgorithm algorithms[] = {ALGORITHM_GROUP, ALGORITHM_TRIANGLE,
+                                     ALGORITHM_TRAPEZOID};
+    int stepSizes[] = {5, 500, 256};
+    for (int i = 0; i < 3; i ++) {
+        openclPricer->setAlgorithm(algorithms[i], stepSizes[i]);
+        auto start = std::chrono::steady_clock::now();
+        double openclPrice = openclPricer->price(optionSpec);
+        auto end = std::chrono::steady_clock::now();
+        std::cout << "[" << names[i] << "] Time: "
+            << std::chrono::duration<double, std::milli> (end - start).count()
+            << " ms, Error: " << std::abs(openclPrice - benchmarkPrice)
+            << std::endl;
+    }
+
+    delete pricer;
 }
+#endif
 
 int main() {
     std::cout << "[INFO] Starting tester main function." << std::endl;
     std::cout << "-------------------------------------" << std::endl;
     
     iterativeBenchmark(500, 2, 5);
+    batchBenchmark(1000, 100);
+    asyncBenchmark(16, 2000);
+    ladderBenchmark(32, 2000);
+    greeksBenchmark(2000);
+    impliedVolatilityBenchmark(64, 200);
+    routingBenchmark(1000, 1000);
+    convergenceBenchmark(800);
+    latticeModelBenchmark(501);
+    dividendBenchmark(1000);
+#ifndef PRICER_CPU_ONLY
+    algorithmBenchmark(20000);
+#endif
 
     std::cout << "-------------------------------------" << std::endl;
     std::cout << "[INFO] Terminating tester main function." << std::endl;
@@ -1,56 +1,178 @@
 // System Libraries
 #include <vector>
 #include <iostream>
-#include <fstream>
 #include <cmath>
 #include <algorithm>
+#include <cstdlib>
+#include <list>
+#include <future>
+#include <atomic>
+#include <thread>
+#include <chrono>
 
 // OpenCL C++ Binding
 #include "cl.hpp"
 
 #include "pricer.h"
 #include "option_spec.h"
+#include "option_batch.h"
+#include "black_scholes.h"
+#include "implied_volatility.h"
+#include "buffer_pool.h"
+#include "kernel_cache.h"
+#include "tuning_table.h"
+#include "lattice_cache.h"
+#include "kernel_source.h"
+#include "lattice_kernels.h"
+
+// Kernel binary cache directory used when PRICER_KERNEL_CACHE is not set
+static const char* DEFAULT_KERNEL_CACHE = "kernel_cache";
+
+// Tuning table file used when PRICER_TUNING_TABLE is not set
+static const char* DEFAULT_TUNING_TABLE = "tuning_table.txt";
+
+// Lattices kept resident on the device, least recently used evicted first
+static const size_t DEVICE_LATTICE_CAPACITY = 32;
+
+// Command queues that asynchronous calls are pipelined across
+static const int NUM_ASYNC_QUEUES = 2;
+
+// Device type named in a DeviceSelector, 0 when the name is unknown
+static cl_device_type parseDeviceType(const std::string& deviceType) {
+    if (deviceType.empty() || deviceType == "all") {
+        return CL_DEVICE_TYPE_ALL;
+    } else if (deviceType == "cpu") {
+        return CL_DEVICE_TYPE_CPU;
+    } else if (deviceType == "gpu") {
+        return CL_DEVICE_TYPE_GPU;
+    } else if (deviceType == "accelerator") {
+        return CL_DEVICE_TYPE_ACCELERATOR;
+    }
+    return 0;
+}
 
 // ---------------------------Constructor--------------------------------------
-OpenCLPricer::OpenCLPricer() {
+OpenCLPricer::OpenCLPricer(Precision precision):
+    OpenCLPricer(DeviceSelector(), precision) {
+}
+
+OpenCLPricer::OpenCLPricer(const DeviceSelector& selector, Precision precision):
+    precision(precision), available(false) {
+    // Left NULL unless setup gets far enough to create them
+    defaultPlatform = NULL;
+    defaultDevice = NULL;
+    context = NULL;
+    kernelCode = NULL;
+    program = NULL;
+    queue = NULL;
+    initKernel = NULL;
+    groupKernel = NULL;
+    trapezoidKernel = NULL;
+    ladderInitKernel = NULL;
+    ladderKernel = NULL;
+    upKernel = NULL;
+    downKernel = NULL;
+    batchKernel = NULL;
+    batchLocalKernel = NULL;
+    batchItemKernel = NULL;
+    impliedVolatilityKernel = NULL;
+    bufferPool = NULL;
+    tuningTable = NULL;
+    numLatticeUses = 0;
+    isAlgorithmFixed = false;
+    isAutoTuning = false;
+    nextAsyncQueue = 0;
+    numPendingJobs = 0;
+
     // Retrieve platforms
     platforms = new std::vector<cl::Platform>();
+    devices = new std::vector<cl::Device>();
     cl::Platform::get(platforms);
 
     // Check number of platforms found
     if (platforms->size() == 0) {
         std::cerr   << "[ERROR] No platform found. Check OpenCL installation!" 
                     << std::endl;
-        exit(1);
+        return;
     } else {
         std::cout   << "[INFO] " << platforms->size() << " platforms found." 
                     << std::endl;
     }
 
-    // TODO(disiok): Add parameters to choose platforms
-    // Select default platform
-    defaultPlatform = &(*platforms)[0];
-    std::cout   << "[INFO] Using platform: " 
-                << defaultPlatform->getInfo<CL_PLATFORM_NAME>() 
-                << std::endl;
+    cl_device_type deviceType = parseDeviceType(selector.deviceType);
+    if (deviceType == 0) {
+        std::cerr   << "[ERROR] Unknown device type: " << selector.deviceType
+                    << std::endl;
+        return;
+    }
 
-    // Retrieve devices
-    devices = new std::vector<cl::Device>();
-    defaultPlatform->getDevices(CL_DEVICE_TYPE_ALL, devices);
+    // Retrieve devices of every platform that match the selector
+    std::vector<int> devicePlatforms;
+    for (size_t i = 0; i < platforms->size(); i ++) {
+        cl::Platform& platform = (*platforms)[i];
+        if (platform.getInfo<CL_PLATFORM_NAME>().find(selector.platformName) ==
+            std::string::npos) {
+            continue;
+        }
+        std::vector<cl::Device> platformDevices;
+        cl_int err = platform.getDevices(CL_DEVICE_TYPE_ALL,
+                                         &platformDevices);
+        // Platforms without devices are skipped, as are those whose query
+        // fails, so that the next platforms can still be used
+        if (err != CL_SUCCESS) {
+            if (err != CL_DEVICE_NOT_FOUND) {
+                std::cerr   << "[ERROR] Error " << err
+                            << " retrieving devices of platform "
+                            << platform.getInfo<CL_PLATFORM_NAME>()
+                            << std::endl;
+            }
+            continue;
+        }
+        for (size_t j = 0; j < platformDevices.size(); j ++) {
+            cl::Device& device = platformDevices[j];
+            if ((device.getInfo<CL_DEVICE_TYPE>() & deviceType) == 0 ||
+                device.getInfo<CL_DEVICE_NAME>().find(selector.deviceName) ==
+                std::string::npos) {
+                continue;
+            }
+            devices->push_back(device);
+            devicePlatforms.push_back(i);
+        }
+    }
 
     // Check number of devices found
     if (devices->size() == 0) {
-        std::cerr   << "[ERROR] No devices found. Check OpenCL installation!" 
+        std::cerr   << "[ERROR] No devices found. Check OpenCL installation "
+                    << "and device selection!" 
                     << std::endl;
-        exit(2);
+        return;
     } else {
         std::cout   << "[INFO] " << devices->size() << " devices found." 
                     << std::endl;
     }
 
-    // TODO(disiok): Add parameters to choose devices
-    // Select default device
-    defaultDevice = &(*devices)[1];
+    // Select device, preferring a GPU when the selector leaves it open
+    int deviceIndex = selector.deviceIndex;
+    if (deviceIndex < 0) {
+        deviceIndex = 0;
+        for (size_t i = 0; i < devices->size(); i ++) {
+            if ((*devices)[i].getInfo<CL_DEVICE_TYPE>() & CL_DEVICE_TYPE_GPU) {
+                deviceIndex = i;
+                break;
+            }
+        }
+    } else if (deviceIndex >= (int) devices->size()) {
+        std::cerr   << "[ERROR] Device index " << deviceIndex
+                    << " out of range, " << devices->size()
+                    << " devices found."
+                    << std::endl;
+        return;
+    }
+    defaultPlatform = &(*platforms)[devicePlatforms[deviceIndex]];
+    defaultDevice = &(*devices)[deviceIndex];
+    std::cout   << "[INFO] Using platform: " 
+                << defaultPlatform->getInfo<CL_PLATFORM_NAME>() 
+                << std::endl;
     std::cout   << "[INFO] Using device: " 
                 << defaultDevice->getInfo<CL_DEVICE_NAME>() 
                 << " (Max work item sizes: "
@@ -62,35 +184,937 @@ OpenCLPricer::OpenCLPricer() {
                 << ")"
                 << std::endl;
 
+    // Double precision kernels need the cl_khr_fp64 extension
+    if (precision == PRECISION_DOUBLE &&
+        defaultDevice->getInfo<CL_DEVICE_EXTENSIONS>().find("cl_khr_fp64") ==
+        std::string::npos) {
+        std::cout   << "[INFO] Device does not support cl_khr_fp64, "
+                    << "falling back to single precision"
+                    << std::endl;
+        this->precision = PRECISION_SINGLE;
+    }
+
     // Create context
-    context = new cl::Context({*defaultDevice});
-
-    // Define kernel code
-    std::ifstream ifs("kernel.cl");
-    kernelCode = new std::string(
-            (std::istreambuf_iterator<char>(ifs)),
-            (std::istreambuf_iterator<char>()));
-    sources = new cl::Program::Sources();
-    sources->push_back({kernelCode->c_str(), kernelCode->length()});
-
-    // Build kernel code
-    program = new cl::Program(*context, *sources);
-    if (program->build({*defaultDevice}) != CL_SUCCESS) {
+    cl_int err;
+    context = new cl::Context({*defaultDevice}, NULL, NULL, NULL, &err);
+    if (err != CL_SUCCESS) {
+        std::cerr   << "[ERROR] Error " << err << " creating context"
+                    << std::endl;
+        delete context;
+        context = NULL;
+        return;
+    }
+
+    // Define kernel code, embedded from kernel.cl at build time
+    kernelCode = new std::string(KERNEL_SOURCE);
+
+    // Build kernel code, or load the binary of an earlier build from the
+    // cache directory given by PRICER_KERNEL_CACHE (empty disables it)
+    const char* cacheDirectory = getenv("PRICER_KERNEL_CACHE");
+    KernelCache kernelCache(cacheDirectory != NULL ?
+                            cacheDirectory : DEFAULT_KERNEL_CACHE);
+    std::string buildOptions = this->precision == PRECISION_DOUBLE ?
+                               "-DREAL_IS_DOUBLE" : "";
+    std::string buildLog;
+    program = kernelCache.build(context, defaultPlatform, defaultDevice,
+                                *kernelCode, buildOptions, &buildLog);
+    if (program == NULL) {
         std::cerr   << "[ERROR] Error building: " 
-                    << program->getBuildInfo<CL_PROGRAM_BUILD_LOG>(*defaultDevice) 
+                    << buildLog
                     << std::endl;
-        exit(4);
+        return;
     } else {
-        std::cout   << "[INFO] Successfully built kernel program" 
+        std::cout   << "[INFO] Successfully built kernel program ("
+                    << (this->precision == PRECISION_DOUBLE ?
+                        "double" : "single")
+                    << " precision)"
                     << std::endl;
     }
 
+    // Create queue and kernels once, arguments are set per pricing call
+    queue = new cl::CommandQueue(*context, *defaultDevice);
+    for (int i = 0; i < NUM_ASYNC_QUEUES; i ++) {
+        asyncQueues.push_back(new cl::CommandQueue(*context, *defaultDevice));
+    }
+    initKernel = new cl::Kernel(*program, "init");
+    groupKernel = new cl::Kernel(*program, "group");
+    trapezoidKernel = new cl::Kernel(*program, "trapezoid");
+    ladderInitKernel = new cl::Kernel(*program, "ladderInit");
+    ladderKernel = new cl::Kernel(*program, "ladder");
+    upKernel = new cl::Kernel(*program, "upTriangle");
+    downKernel = new cl::Kernel(*program, "downTriangle");
+    batchKernel = new cl::Kernel(*program, "batch");
+    batchLocalKernel = new cl::Kernel(*program, "batchLocal");
+    batchItemKernel = new cl::Kernel(*program, "batchItem");
+    impliedVolatilityKernel = new cl::Kernel(*program, "impliedVolatility");
+    bufferPool = new BufferPool(context);
+
+    // Tuning results of earlier runs, from the file given by
+    // PRICER_TUNING_TABLE (empty keeps them in memory). PRICER_AUTOTUNE=1
+    // tunes numSteps buckets the table does not have yet on first use
+    const char* tuningTablePath = getenv("PRICER_TUNING_TABLE");
+    tuningTable = new TuningTable(tuningTablePath != NULL ?
+                                  tuningTablePath : DEFAULT_TUNING_TABLE);
+    deviceKey = defaultPlatform->getInfo<CL_PLATFORM_NAME>() + "|" +
+                defaultDevice->getInfo<CL_DEVICE_NAME>() + "|" +
+                defaultDevice->getInfo<CL_DRIVER_VERSION>() + "|" +
+                (this->precision == PRECISION_DOUBLE ? "double" : "single");
+    const char* autoTune = getenv("PRICER_AUTOTUNE");
+    isAutoTuning = autoTune != NULL && std::string(autoTune) != "" &&
+                   std::string(autoTune) != "0";
+
+    // NOTE(disiok): Default to improved triangle algorithm until tuned
+    algorithm = ALGORITHM_TRIANGLE;
+    algorithmStepSize = 500;
+    available = true;
+}
+
+bool OpenCLPricer::isAvailable() const {
+    return available;
+}
+
+void OpenCLPricer::setAlgorithm(LatticeAlgorithm algorithm, int stepSize) {
+    this->algorithm = algorithm;
+    algorithmStepSize = stepSize;
+    isAlgorithmFixed = true;
+}
+
+void OpenCLPricer::chooseAlgorithm(int numSteps, LatticeAlgorithm* algorithm,
+                                   int* stepSize) const {
+    TuningEntry entry;
+    if (!isAlgorithmFixed &&
+        tuningTable->lookup(deviceKey, numSteps, &entry)) {
+        *algorithm = entry.algorithm;
+        *stepSize = entry.stepSize;
+    } else {
+        *algorithm = this->algorithm;
+        *stepSize = algorithmStepSize;
+    }
+}
+
+int OpenCLPricer::maxTriangleStepSize() const {
+    // Work groups of stepSize + 1 work-items, each holding one real in
+    // local memory
+    size_t realSize = precision == PRECISION_DOUBLE ?
+                      sizeof(double) : sizeof(float);
+    size_t maxGroupSize = std::min(
+            upKernel->getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(
+                *defaultDevice),
+            downKernel->getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(
+                *defaultDevice));
+    maxGroupSize = std::min<size_t>(maxGroupSize,
+            defaultDevice->getInfo<CL_DEVICE_LOCAL_MEM_SIZE>() / realSize);
+    return maxGroupSize - 1;
+}
+
+// Work items cooperating on the lattice of a single option in the batch kernel
+static const int BATCH_GROUP_SIZE = 64;
+
+// Lattices of fewer steps are priced whole by one work group of the batch
+// kernels, larger ones by the algorithm chosen for them
+static const int SMALL_LATTICE_STEPS = 500;
+
+// Largest numSteps priced by a single work-item in the batchItem kernel
+static const int BATCH_ITEM_MAX_STEPS = 32;
+
+// Work items of a trapezoid work group, and lattice points each produces
+static const int TRAPEZOID_GROUP_SIZE = 256;
+static const int TRAPEZOID_POINTS_PER_ITEM = 4;
+
+// Smallest tile of the ladder kernel, bounding the strikes per sweep so that
+// tiles do not shrink to a few lattice points
+static const int LADDER_MIN_TILE_SIZE = 128;
+
+// Step sizes swept by tune(), powers of two within these ranges and the
+// device limits
+static const int TUNE_MAX_GROUP_SIZE = 32;
+static const int TUNE_MIN_STEP_SIZE = 16;
+static const int TUNE_MAX_TRAPEZOID_STEPS = 1024;
+
+/**
+ * Writes upFactor^k and downFactor^k for k = 0..numSteps into upPowers and
+ * downPowers, generated with powerTable instead of a pow() per lattice node
+ */
+template <typename Real>
+static void powerTables(Real* upPowers, Real* downPowers,
+                        Real upFactor, Real downFactor, int numSteps) {
+    std::vector<double> powers(numSteps + 1);
+    powerTable(&powers[0], upFactor, numSteps);
+    std::copy(powers.begin(), powers.end(), upPowers);
+    powerTable(&powers[0], downFactor, numSteps);
+    std::copy(powers.begin(), powers.end(), downPowers);
+}
+
+/**
+ * Host state of one pricing call in flight on a command queue
+ *
+ * Non-blocking uploads read from host arrays owned by the job, and pooled
+ * buffers only go back to the pool once the results have been read, so the
+ * job has to outlive the last command of the call
+ */
+template <typename Real>
+struct PricingJob {
+    PricingJob(BufferPool* bufferPool): bufferPool(bufferPool),
+                                        isBatch(false), numPendingJobs(NULL) {}
+
+    BufferPool* bufferPool;
+    // Lists so that host arrays never move while an upload reads them
+    std::list<std::vector<Real> > realData;
+    std::list<std::vector<int> > intData;
+    // Batch priced by the job when the caller's does not outlive it
+    OptionBatch optionBatch;
+    std::vector<cl::Buffer> buffers;
+    std::vector<Real> results;
+
+    // Fulfilled by the completion callback of asynchronous calls
+    bool isBatch;
+    std::promise<double> promise;
+    std::promise<std::vector<double> > batchPromise;
+    std::atomic<int>* numPendingJobs;
+};
+
+// Moves data into the job, keeping it alive until the job completes
+template <typename Real>
+static std::vector<Real>& keep(PricingJob<Real>* job, std::vector<Real>& data) {
+    job->realData.push_back(std::vector<Real>());
+    job->realData.back().swap(data);
+    return job->realData.back();
+}
+
+template <typename Real>
+static std::vector<int>& keep(PricingJob<Real>* job, std::vector<int>& data) {
+    job->intData.push_back(std::vector<int>());
+    job->intData.back().swap(data);
+    return job->intData.back();
+}
+
+// Acquires a pooled buffer that is released when the job completes
+template <typename Real>
+static cl::Buffer acquire(PricingJob<Real>* job, size_t size) {
+    cl::Buffer buffer = job->bufferPool->acquire(size);
+    job->buffers.push_back(buffer);
+    return buffer;
+}
+
+// Uploads a column of an OptionBatch into a pooled buffer without blocking,
+// reading it in place
+template <typename T, typename Real>
+static cl::Buffer uploadColumn(cl::CommandQueue* queue, PricingJob<Real>* job,
+                               const AlignedVector<T>& column) {
+    cl::Buffer buffer = acquire(job, sizeof(T) * column.size());
+    queue->enqueueWriteBuffer(buffer,
+                              CL_FALSE,
+                              0,
+                              sizeof(T) * column.size(),
+                              &column[0]);
+    return buffer;
+}
+
+// Uploads data into a pooled buffer without blocking, data is moved into
+// the job and left empty
+template <typename T, typename Real>
+static cl::Buffer upload(cl::CommandQueue* queue, PricingJob<Real>* job,
+                         std::vector<T>& data) {
+    std::vector<T>& hostData = keep(job, data);
+    cl::Buffer buffer = acquire(job, sizeof(T) * hostData.size());
+    queue->enqueueWriteBuffer(buffer,
+                              CL_FALSE,
+                              0,
+                              sizeof(T) * hostData.size(),
+                              &hostData[0]);
+    return buffer;
+}
+
+/**
+ * Uploads the present value of the discrete dividends still to be paid at
+ * every time-step of the lattice of optionSpec, which early exercise adds
+ * back to the node prices
+ * Returns a null buffer, read by the kernels as no dividends, for options
+ * without discrete dividends or early exercise
+ */
+template <typename Real>
+static cl::Buffer uploadDividendEscrows(cl::CommandQueue* queue,
+                                        PricingJob<Real>* job,
+                                        const OptionSpec& optionSpec,
+                                        const Lattice& lattice) {
+    if (optionSpec.numDividends == 0 || !optionSpec.isAmerican) {
+        return cl::Buffer();
+    }
+    std::vector<Real> escrows(optionSpec.numSteps + 1);
+    for (int i = 0; i <= optionSpec.numSteps; i ++) {
+        escrows[i] = dividendEscrow(optionSpec, i * lattice.deltaT);
+    }
+    return upload(queue, job, escrows);
+}
+
+template <typename Real>
+static void releaseBuffers(PricingJob<Real>* job) {
+    for (size_t i = 0; i < job->buffers.size(); i ++) {
+        job->bufferPool->release(job->buffers[i]);
+    }
+    job->buffers.clear();
+}
+
+// Reads numResults results into the job, blocking until they are ready
+template <typename Real>
+static void readResults(cl::CommandQueue* queue, const cl::Buffer& results,
+                        int numResults, PricingJob<Real>* job) {
+    job->results.resize(numResults);
+    queue->enqueueReadBuffer(results,
+                             CL_TRUE,
+                             0,
+                             sizeof(Real) * numResults,
+                             &job->results[0]);
+    releaseBuffers(job);
+}
+
+/**
+ * Runs on a runtime thread once the read of an asynchronous job completes
+ * NOTE(disiok): Only host work here, OpenCL forbids blocking calls in
+ * event callbacks
+ */
+template <typename Real>
+static void CL_CALLBACK completeJob(cl_event event, cl_int status,
+                                    void* data) {
+    PricingJob<Real>* job = static_cast<PricingJob<Real>*>(data);
+    std::vector<double> prices(job->results.begin(), job->results.end());
+    if (status != CL_COMPLETE) {
+        std::cerr   << "[ERROR] Asynchronous pricing failed with status "
+                    << status
+                    << std::endl;
+        std::fill(prices.begin(), prices.end(), NAN);
+    }
+    releaseBuffers(job);
+    if (job->isBatch) {
+        job->batchPromise.set_value(prices);
+    } else {
+        job->promise.set_value(prices[0]);
+    }
+    std::atomic<int>* numPendingJobs = job->numPendingJobs;
+    delete job;
+    (*numPendingJobs)--;
+}
+
+// Reads numResults results into the job without blocking, completing the
+// job from an event callback
+template <typename Real>
+static void readResultsAsync(cl::CommandQueue* queue,
+                             const cl::Buffer& results, int numResults,
+                             PricingJob<Real>* job) {
+    job->results.resize(numResults);
+    cl::Event readEvent;
+    queue->enqueueReadBuffer(results,
+                             CL_FALSE,
+                             0,
+                             sizeof(Real) * numResults,
+                             &job->results[0],
+                             NULL,
+                             &readEvent);
+    readEvent.setCallback(CL_COMPLETE, &completeJob<Real>, job);
+
+    // Submit right away instead of when the queue is next used
+    queue->flush();
+}
+
+// ----------------------------Pricing calls-----------------------------------
+double OpenCLPricer::priceLattice(OptionSpec& optionSpec) {
+    TuningEntry entry;
+    if (isAutoTuning && !isAlgorithmFixed &&
+        latticeModel != LATTICE_TRINOMIAL &&
+        optionSpec.numSteps >= SMALL_LATTICE_STEPS &&
+        !tuningTable->lookup(deviceKey, optionSpec.numSteps, &entry)) {
+        tune(optionSpec.numSteps);
+    }
+    if (precision == PRECISION_DOUBLE) {
+        return priceImplOption<double>(optionSpec);
+    }
+    return priceImplOption<float>(optionSpec);
+}
+
+void OpenCLPricer::priceLattice(const OptionBatch& optionBatch,
+                                std::vector<double>& prices) {
+    if (precision == PRECISION_DOUBLE) {
+        priceImplBatch<double>(optionBatch, prices);
+    } else {
+        priceImplBatch<float>(optionBatch, prices);
+    }
+}
+
+void OpenCLPricer::priceLadder(const OptionSpec& optionSpec,
+                               const std::vector<float>& strikePrices,
+                               std::vector<double>& prices) {
+    // The ladder kernels value expiry with payoffs only and share one
+    // binomial lattice between strikes, which Leisen-Reimer centres on
+    // a single strike
+    if (isSmoothed() || latticeModel == LATTICE_LEISEN_REIMER ||
+        latticeModel == LATTICE_TRINOMIAL) {
+        OptionPricer::priceLadder(optionSpec, strikePrices, prices);
+        return;
+    }
+    OptionSpec spec = latticeSpec(optionSpec);
+    if (precision == PRECISION_DOUBLE) {
+        priceImplLadder<double>(spec, strikePrices, prices);
+    } else {
+        priceImplLadder<float>(spec, strikePrices, prices);
+    }
+}
+
+OptionGreeks OpenCLPricer::priceWithGreeks(const OptionSpec& optionSpec) {
+    // Nodes near the root are kept by the binomial up triangles only
+    if (latticeModel == LATTICE_TRINOMIAL) {
+        return OptionPricer::priceWithGreeks(optionSpec);
+    }
+    if (precision == PRECISION_DOUBLE) {
+        return priceImplGreeks<double>(optionSpec);
+    }
+    return priceImplGreeks<float>(optionSpec);
+}
+
+void OpenCLPricer::impliedVolatility(const OptionBatch& optionBatch,
+                                     const std::vector<double>& marketPrices,
+                                     std::vector<double>& volatilities) {
+    // The impliedVolatility kernel walks plain lattices only
+    if (isSmoothed() || convergenceMode == CONVERGENCE_BBSR) {
+        OptionPricer::impliedVolatility(optionBatch, marketPrices,
+                                        volatilities);
+        return;
+    }
+    // Without the dividends paid after maturity, as price() walks them
+    OptionBatch latticeBatch;
+    latticeBatch.reserve(optionBatch.size());
+    for (size_t i = 0; i < optionBatch.size(); i ++) {
+        latticeBatch.push_back(latticeSpec(optionBatch[i]));
+    }
+    if (precision == PRECISION_DOUBLE) {
+        impliedVolatilityImpl<double>(latticeBatch, marketPrices,
+                                      volatilities);
+    } else {
+        impliedVolatilityImpl<float>(latticeBatch, marketPrices,
+                                     volatilities);
+    }
+}
+
+void OpenCLPricer::tune(int numSteps) {
+    if (precision == PRECISION_DOUBLE) {
+        tuneImpl<double>(numSteps);
+    } else {
+        tuneImpl<float>(numSteps);
+    }
+}
+
+// BBSR combines two lattices on the host, so its prices are ready on return
+std::future<double> OpenCLPricer::priceAsync(const OptionSpec& optionSpec) {
+    if (convergenceMode == CONVERGENCE_BBSR) {
+        OptionSpec spec = optionSpec;
+        std::promise<double> promise;
+        promise.set_value(price(spec));
+        return promise.get_future();
+    }
+    OptionSpec spec = latticeSpec(optionSpec);
+    if (precision == PRECISION_DOUBLE) {
+        return priceAsyncImpl<double>(spec);
+    }
+    return priceAsyncImpl<float>(spec);
+}
+
+std::future<std::vector<double> > OpenCLPricer::priceAsync(
+        const std::vector<OptionSpec>& optionSpecs) {
+    if (convergenceMode == CONVERGENCE_BBSR) {
+        std::vector<double> prices;
+        price(optionSpecs, prices);
+        std::promise<std::vector<double> > promise;
+        promise.set_value(prices);
+        return promise.get_future();
+    }
+    std::vector<OptionSpec> specs(optionSpecs.size());
+    for (size_t i = 0; i < optionSpecs.size(); i ++) {
+        specs[i] = latticeSpec(optionSpecs[i]);
+    }
+    if (precision == PRECISION_DOUBLE) {
+        return priceAsyncImpl<double>(specs);
+    }
+    return priceAsyncImpl<float>(specs);
+}
+
+template <typename Real>
+double OpenCLPricer::priceImplOption(const OptionSpec& optionSpec) {
+    PricingJob<Real> job(bufferPool);
+    cl::Buffer results = enqueueOption(queue, optionSpec, &job);
+    readResults(queue, results, 1, &job);
+    return job.results[0];
+}
+
+template <typename Real>
+void OpenCLPricer::priceImplBatch(const OptionBatch& optionBatch,
+                                  std::vector<double>& prices) {
+    prices.resize(optionBatch.size());
+    if (optionBatch.size() == 0) {
+        return;
+    }
+    PricingJob<Real> job(bufferPool);
+    cl::Buffer results = enqueueBatch(queue, optionBatch, &job);
+    readResults(queue, results, optionBatch.size(), &job);
+    std::copy(job.results.begin(), job.results.end(), prices.begin());
+}
+
+template <typename Real>
+double OpenCLPricer::priceImplGroup(OptionSpec& optionSpec, int groupSize) {
+    PricingJob<Real> job(bufferPool);
+    cl::Buffer results = enqueueGroup(queue, optionSpec, groupSize, &job);
+    readResults(queue, results, 1, &job);
+    return job.results[0];
+}
+
+template <typename Real>
+double OpenCLPricer::priceImplTriangle(OptionSpec& optionSpec, int stepSize) {
+    PricingJob<Real> job(bufferPool);
+    cl::Buffer results = enqueueTriangle(queue, optionSpec, stepSize, &job);
+    readResults(queue, results, 1, &job);
+    return job.results[0];
+}
+
+template <typename Real>
+double OpenCLPricer::priceImplTrapezoid(OptionSpec& optionSpec,
+                                        int stepsPerLaunch) {
+    PricingJob<Real> job(bufferPool);
+    cl::Buffer results = enqueueTrapezoid(queue, optionSpec, stepsPerLaunch,
+                                          &job);
+    readResults(queue, results, 1, &job);
+    return job.results[0];
+}
+
+/**
+ * Always priced with the triangle algorithm, at the tuned step size when the
+ * tuning table chose triangles, with a single triangle covering lattices of
+ * up to stepSize time-steps so that the root is reached by an up triangle
+ */
+template <typename Real>
+OptionGreeks OpenCLPricer::priceImplGreeks(const OptionSpec& optionSpec) {
+    // Gamma and theta need the nodes of time-step 2, BBS takes one away
+    OptionSpec spec = optionSpec;
+    spec.numSteps = std::max(spec.numSteps, isSmoothed() ? 3 : 2);
+    spec = latticeSpec(spec);
+
+    LatticeAlgorithm algorithm;
+    int stepSize;
+    chooseAlgorithm(spec.numSteps, &algorithm, &stepSize);
+    if (algorithm != ALGORITHM_TRIANGLE) {
+        stepSize = maxTriangleStepSize();
+    }
+    stepSize = std::max(2, std::min(std::min(stepSize, maxTriangleStepSize()),
+                                    spec.numSteps));
+
+    PricingJob<Real> job(bufferPool);
+    cl::Buffer nearRootBuffer;
+    enqueueTriangle(queue, spec, stepSize, &job, &nearRootBuffer);
+    readResults(queue, nearRootBuffer, NUM_NEAR_ROOT_VALUES, &job);
+
+    double nearRootValues[NUM_NEAR_ROOT_VALUES];
+    std::copy(job.results.begin(), job.results.end(), nearRootValues);
+    return deviceLattice<Real>(queue, spec).lattice->greeks(nearRootValues);
+}
+
+/**
+ * Algorithm:
+ *  impliedVolatility kernel:
+ *      One work group of BATCH_GROUP_SIZE work-items per option, starting
+ *      from the Black-Scholes estimate computed on the host
+ *      Each iteration walks the lattice of the option twice, like the batch
+ *      kernel, for the price and the vega, and takes a safeguarded Newton
+ *      step as VolatilitySearch does
+ *      Iterations stay on the device, the whole batch is searched with a
+ *      single kernel execution and a single read of the results
+ */
+template <typename Real>
+void OpenCLPricer::impliedVolatilityImpl(
+        const OptionBatch& optionBatch,
+        const std::vector<double>& marketPrices,
+        std::vector<double>& volatilities) {
+    int numOptions = optionBatch.size();
+    volatilities.resize(numOptions);
+    if (numOptions == 0) {
+        return;
+    }
+
+    // Lattices and node price tables of every option, as in enqueueBatch
+    int span = latticeBranches(latticeModel) - 1;
+    std::vector<int> offsets(numOptions);
+    std::vector<Real> targets(numOptions);
+    std::vector<Real> initialVolatilities(numOptions);
+    int totalNumLattice = 0;
+    for (int i = 0; i < numOptions; i ++) {
+        offsets[i] = totalNumLattice;
+        int numSteps = latticeSteps(latticeModel, optionBatch.numSteps[i]);
+        totalNumLattice += 2 * (span * numSteps + 1);
+        targets[i] = marketPrices[i];
+        initialVolatilities[i] = blackScholesVolatilityEstimate(
+                optionBatch[i], marketPrices[i]);
+    }
+
+    PricingJob<Real> job(bufferPool);
+    cl::Buffer columns[] = {
+        uploadColumn(queue, &job, optionBatch.type),
+        uploadColumn(queue, &job, optionBatch.stockPrice),
+        uploadColumn(queue, &job, optionBatch.strikePrice),
+        uploadColumn(queue, &job, optionBatch.yearsToMaturity),
+        uploadColumn(queue, &job, optionBatch.volatility),
+        uploadColumn(queue, &job, optionBatch.riskFreeRate),
+        uploadColumn(queue, &job, optionBatch.numSteps),
+        uploadColumn(queue, &job, optionBatch.isAmerican),
+        uploadColumn(queue, &job, optionBatch.dividendYield),
+        uploadColumn(queue, &job, optionBatch.numDividends),
+        uploadColumn(queue, &job, optionBatch.dividendTimes),
+        uploadColumn(queue, &job, optionBatch.dividendAmounts)
+    };
+    const int numColumns = sizeof(columns) / sizeof(columns[0]);
+    cl::Buffer offsetsBuffer = upload(queue, &job, offsets);
+    cl::Buffer targetsBuffer = upload(queue, &job, targets);
+    cl::Buffer initialBuffer = upload(queue, &job, initialVolatilities);
+    cl::Buffer valueBuffer = acquire(&job, sizeof(Real) * totalNumLattice);
+    cl::Buffer powersBuffer = acquire(&job, sizeof(Real) * totalNumLattice);
+    cl::Buffer resultBuffer = acquire(&job, sizeof(Real) * numOptions);
+
+    int groupSize = std::min<int>(BATCH_GROUP_SIZE,
+            defaultDevice->getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>());
+    for (int i = 0; i < numColumns; i ++) {
+        impliedVolatilityKernel->setArg(i, columns[i]);
+    }
+    impliedVolatilityKernel->setArg(12, offsetsBuffer);
+    impliedVolatilityKernel->setArg(13, valueBuffer);
+    impliedVolatilityKernel->setArg(14, powersBuffer);
+    impliedVolatilityKernel->setArg(15, targetsBuffer);
+    impliedVolatilityKernel->setArg(16, initialBuffer);
+    impliedVolatilityKernel->setArg(17, resultBuffer);
+    impliedVolatilityKernel->setArg(18, (Real) IMPLIED_VOLATILITY_MIN);
+    impliedVolatilityKernel->setArg(19, (Real) IMPLIED_VOLATILITY_MAX);
+    impliedVolatilityKernel->setArg(20, (Real) IMPLIED_VOLATILITY_BUMP);
+    impliedVolatilityKernel->setArg(21, (Real) IMPLIED_VOLATILITY_TOLERANCE);
+    impliedVolatilityKernel->setArg(22, IMPLIED_VOLATILITY_MAX_ITERATIONS);
+    impliedVolatilityKernel->setArg(23, (int) latticeModel);
+    queue->enqueueNDRangeKernel(*impliedVolatilityKernel,
+                                cl::NullRange,
+                                cl::NDRange(numOptions * groupSize),
+                                cl::NDRange(groupSize));
+    readResults(queue, resultBuffer, numOptions, &job);
+
+    for (int i = 0; i < numOptions; i ++) {
+        volatilities[i] = impliedVolatilityResult(job.results[i]);
+    }
+}
+
+/**
+ * Strikes are swept as many at a time as fit in local memory next to a tile
+ * of LADDER_MIN_TILE_SIZE lattice points
+ */
+template <typename Real>
+void OpenCLPricer::priceImplLadder(const OptionSpec& optionSpec,
+                                   const std::vector<float>& strikePrices,
+                                   std::vector<double>& prices) {
+    int numStrikes = strikePrices.size();
+    prices.resize(numStrikes);
+    int strikesPerSweep = std::max<int>(1,
+        defaultDevice->getInfo<CL_DEVICE_LOCAL_MEM_SIZE>() /
+        (2 * sizeof(Real) * LADDER_MIN_TILE_SIZE));
+    for (int first = 0; first < numStrikes; first += strikesPerSweep) {
+        int numSweepStrikes = std::min(strikesPerSweep, numStrikes - first);
+        PricingJob<Real> job(bufferPool);
+        cl::Buffer results = enqueueLadder(queue, optionSpec,
+                                           &strikePrices[first],
+                                           numSweepStrikes, &job);
+        readResults(queue, results, numSweepStrikes, &job);
+        std::copy(job.results.begin(), job.results.end(),
+                  prices.begin() + first);
+    }
+}
+
+/**
+ * Sweeps candidates on an American put of the bucket's numSteps
+ *  group: 1 to TUNE_MAX_GROUP_SIZE lattice points per work-item
+ *  triangle: TUNE_MIN_STEP_SIZE up to the work group and local memory limits
+ *  trapezoid: TUNE_MIN_STEP_SIZE to TUNE_MAX_TRAPEZOID_STEPS steps per launch
+ */
+template <typename Real>
+void OpenCLPricer::tuneImpl(int numSteps) {
+    int bucketSteps = TuningTable::bucket(numSteps);
+    OptionSpec optionSpec = {-1, 100, 100, 1.0, 0.3, 0.02, bucketSteps, true};
+
+    std::vector<TuningEntry> candidates;
+    for (int i = 1; i <= TUNE_MAX_GROUP_SIZE; i *= 2) {
+        TuningEntry candidate = {ALGORITHM_GROUP, i, 0};
+        candidates.push_back(candidate);
+    }
+    int maxStepSize = std::min(maxTriangleStepSize(), bucketSteps);
+    for (int i = TUNE_MIN_STEP_SIZE; i <= maxStepSize; i *= 2) {
+        TuningEntry candidate = {ALGORITHM_TRIANGLE, i, 0};
+        candidates.push_back(candidate);
+    }
+    int maxTrapezoidSteps = std::min(TUNE_MAX_TRAPEZOID_STEPS, bucketSteps);
+    for (int i = TUNE_MIN_STEP_SIZE; i <= maxTrapezoidSteps; i *= 2) {
+        TuningEntry candidate = {ALGORITHM_TRAPEZOID, i, 0};
+        candidates.push_back(candidate);
+    }
+
+    // Warm up the buffer pool so that no candidate pays for allocations
+    priceImplTrapezoid<Real>(optionSpec, TUNE_MIN_STEP_SIZE);
+
+    TuningEntry best = candidates[0];
+    for (size_t i = 0; i < candidates.size(); i ++) {
+        TuningEntry& candidate = candidates[i];
+        auto start = std::chrono::steady_clock::now();
+        if (candidate.algorithm == ALGORITHM_GROUP) {
+            priceImplGroup<Real>(optionSpec, candidate.stepSize);
+        } else if (candidate.algorithm == ALGORITHM_TRIANGLE) {
+            priceImplTriangle<Real>(optionSpec, candidate.stepSize);
+        } else {
+            priceImplTrapezoid<Real>(optionSpec, candidate.stepSize);
+        }
+        auto end = std::chrono::steady_clock::now();
+        candidate.milliseconds =
+            std::chrono::duration<double, std::milli>(end - start).count();
+        if (i == 0 || candidate.milliseconds < best.milliseconds) {
+            best = candidate;
+        }
+    }
+
+    const char* names[] = {"group", "triangle", "trapezoid"};
+    std::cout   << "[INFO] Tuned " << bucketSteps << " steps: "
+                << names[best.algorithm] << " with step size "
+                << best.stepSize << " (" << best.milliseconds << " ms)"
+                << std::endl;
+    tuningTable->record(deviceKey, bucketSteps, best);
 }
 
-double OpenCLPricer::price(OptionSpec& optionSpec) {
-    // NOTE(disiok): Default to improved triangle algorithm
-    return priceImplTriangle(optionSpec, 500); 
-    // return priceImplGroup(optionSpec, 5); 
+/**
+ * Asynchronous calls go round robin over the async queues, so that the
+ * uploads and kernels of one call overlap with those of the previous one
+ * and with the host preparing the next
+ */
+template <typename Real>
+std::future<double> OpenCLPricer::priceAsyncImpl(
+        const OptionSpec& optionSpec) {
+    PricingJob<Real>* job = new PricingJob<Real>(bufferPool);
+    job->numPendingJobs = &numPendingJobs;
+    numPendingJobs++;
+    // Taken before enqueueing, the callback may delete the job at any time
+    std::future<double> future = job->promise.get_future();
+
+    cl::CommandQueue* asyncQueue = asyncQueues[nextAsyncQueue];
+    nextAsyncQueue = (nextAsyncQueue + 1) % asyncQueues.size();
+    cl::Buffer results = enqueueOption(asyncQueue, optionSpec, job);
+    readResultsAsync(asyncQueue, results, 1, job);
+    return future;
+}
+
+template <typename Real>
+std::future<std::vector<double> > OpenCLPricer::priceAsyncImpl(
+        const std::vector<OptionSpec>& optionSpecs) {
+    PricingJob<Real>* job = new PricingJob<Real>(bufferPool);
+    job->isBatch = true;
+    std::future<std::vector<double> > future =
+        job->batchPromise.get_future();
+    if (optionSpecs.empty()) {
+        job->batchPromise.set_value(std::vector<double>());
+        delete job;
+        return future;
+    }
+    job->numPendingJobs = &numPendingJobs;
+    numPendingJobs++;
+
+    cl::CommandQueue* asyncQueue = asyncQueues[nextAsyncQueue];
+    nextAsyncQueue = (nextAsyncQueue + 1) % asyncQueues.size();
+    job->optionBatch = OptionBatch(optionSpecs);
+    cl::Buffer results = enqueueBatch(asyncQueue, job->optionBatch, job);
+    readResultsAsync(asyncQueue, results, optionSpecs.size(), job);
+    return future;
+}
+
+template <typename Real>
+OpenCLPricer::DeviceLattice OpenCLPricer::deviceLattice(
+        cl::CommandQueue* queue, const OptionSpec& optionSpec) {
+    LatticeKey key(optionSpec, latticeModel);
+    numLatticeUses++;
+    std::map<LatticeKey, DeviceLattice>::iterator it =
+        deviceLattices.find(key);
+    if (it != deviceLattices.end()) {
+        it->second.lastUse = numLatticeUses;
+        return it->second;
+    }
+
+    if (deviceLattices.size() >= DEVICE_LATTICE_CAPACITY) {
+        std::map<LatticeKey, DeviceLattice>::iterator oldest =
+            deviceLattices.begin();
+        for (it = deviceLattices.begin(); it != deviceLattices.end(); ++it) {
+            if (it->second.lastUse < oldest->second.lastUse) {
+                oldest = it;
+            }
+        }
+        deviceLattices.erase(oldest);
+    }
+
+    DeviceLattice lattice;
+    lattice.lattice.reset(new Lattice(key));
+    lattice.lastUse = numLatticeUses;
+    int numNodes = lattice.lattice->numNodes(optionSpec.numSteps);
+    std::vector<Real> upPowers(numNodes);
+    std::vector<Real> downPowers(numNodes);
+    powerTables(&upPowers[0], &downPowers[0],
+                (Real) lattice.lattice->upFactor,
+                (Real) lattice.lattice->downFactor, numNodes - 1);
+
+    // NOTE(disiok): Blocking uploads, so that the tables are complete before
+    // a call on any of the queues uses them
+    size_t size = sizeof(Real) * numNodes;
+    lattice.upPowers = cl::Buffer(*context, CL_MEM_READ_ONLY, size);
+    lattice.downPowers = cl::Buffer(*context, CL_MEM_READ_ONLY, size);
+    queue->enqueueWriteBuffer(lattice.upPowers, CL_TRUE, 0, size,
+                              &upPowers[0]);
+    queue->enqueueWriteBuffer(lattice.downPowers, CL_TRUE, 0, size,
+                              &downPowers[0]);
+    deviceLattices[key] = lattice;
+    return lattice;
+}
+
+template <typename Real>
+cl::Buffer OpenCLPricer::enqueueOption(cl::CommandQueue* queue,
+                                       const OptionSpec& optionSpec,
+                                       PricingJob<Real>* job) {
+    // Small lattices are priced whole by one work group, which the batch
+    // kernels already do. So are trinomial lattices, the other algorithms
+    // follow binomial dependencies
+    if (optionSpec.numSteps < SMALL_LATTICE_STEPS ||
+        latticeModel == LATTICE_TRINOMIAL) {
+        job->optionBatch.push_back(optionSpec);
+        return enqueueBatch(queue, job->optionBatch, job);
+    }
+
+    LatticeAlgorithm algorithm;
+    int stepSize;
+    chooseAlgorithm(optionSpec.numSteps, &algorithm, &stepSize);
+    if (algorithm == ALGORITHM_GROUP) {
+        return enqueueGroup(queue, optionSpec, stepSize, job);
+    } else if (algorithm == ALGORITHM_TRAPEZOID) {
+        return enqueueTrapezoid(queue, optionSpec, stepSize, job);
+    }
+    return enqueueTriangle(queue, optionSpec, stepSize, job);
+}
+
+/**
+ * Algorithm:
+ *  batch kernel:
+ *      One work group of BATCH_GROUP_SIZE work-items per option
+ *      Each work group derives the lattice parameters and node price tables
+ *      of its option from the OptionBatch columns, so the host does no
+ *      per-option preparation beyond the lattice offsets
+ *      Each work group computes the option values at expiry and iterates
+ *      backwards through its own slice of a shared global buffer
+ *      Whole batch priced with a single kernel execution
+ *
+ *  batchLocal kernel:
+ *      Same as the batch kernel, but the double buffered lattice lives in
+ *      local memory, used when the largest lattice of the batch fits
+ *
+ *  batchItem kernel:
+ *      One work-item per option iterating its lattice alone in a slice of
+ *      local memory, used for tiny trees of up to BATCH_ITEM_MAX_STEPS
+ *      steps where a work group per option would mostly idle
+ */
+template <typename Real>
+cl::Buffer OpenCLPricer::enqueueBatch(cl::CommandQueue* queue,
+                                      const OptionBatch& optionBatch,
+                                      PricingJob<Real>* job) {
+    int numOptions = optionBatch.size();
+
+    // Each option needs two lattices of as many points as its last
+    // time-step, and its two node price tables share the same layout
+    int span = latticeBranches(latticeModel) - 1;
+    std::vector<int> offsets(numOptions);
+    int totalNumLattice = 0;
+    int maxNumSteps = 0;
+    for (int i = 0; i < numOptions; i ++) {
+        offsets[i] = totalNumLattice;
+        int numSteps = latticeSteps(latticeModel, optionBatch.numSteps[i]);
+        totalNumLattice += 2 * (span * numSteps + 1);
+        maxNumSteps = std::max(maxNumSteps, numSteps);
+    }
+
+    // Acquire buffers on the devices and upload the batch one column at a
+    // time, lattice parameters and node prices are derived by the kernels
+    cl::Buffer columns[] = {
+        uploadColumn(queue, job, optionBatch.type),
+        uploadColumn(queue, job, optionBatch.stockPrice),
+        uploadColumn(queue, job, optionBatch.strikePrice),
+        uploadColumn(queue, job, optionBatch.yearsToMaturity),
+        uploadColumn(queue, job, optionBatch.volatility),
+        uploadColumn(queue, job, optionBatch.riskFreeRate),
+        uploadColumn(queue, job, optionBatch.numSteps),
+        uploadColumn(queue, job, optionBatch.isAmerican),
+        uploadColumn(queue, job, optionBatch.dividendYield),
+        uploadColumn(queue, job, optionBatch.numDividends),
+        uploadColumn(queue, job, optionBatch.dividendTimes),
+        uploadColumn(queue, job, optionBatch.dividendAmounts)
+    };
+    const int numColumns = sizeof(columns) / sizeof(columns[0]);
+    cl::Buffer offsetsBuffer = upload(queue, job, offsets);
+    cl::Buffer powersBuffer = acquire(job, sizeof(Real) * totalNumLattice);
+    cl::Buffer resultBuffer = acquire(job, sizeof(Real) * numOptions);
+
+    // Run the batch kernel suited to the largest lattice of the batch
+    int maxNumNodes = span * maxNumSteps + 1;
+    size_t latticeSize = sizeof(Real) * maxNumNodes;
+    cl_ulong localMemSize = defaultDevice->getInfo<CL_DEVICE_LOCAL_MEM_SIZE>();
+    int groupSize = std::min<int>(BATCH_GROUP_SIZE,
+            defaultDevice->getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>());
+    int itemGroupSize = std::min<int>(groupSize, localMemSize / latticeSize);
+    if (maxNumSteps <= BATCH_ITEM_MAX_STEPS && itemGroupSize > 0) {
+        int numWorkGroups = (numOptions + itemGroupSize - 1) / itemGroupSize;
+        for (int i = 0; i < numColumns; i ++) {
+            batchItemKernel->setArg(i, columns[i]);
+        }
+        batchItemKernel->setArg(12, offsetsBuffer);
+        batchItemKernel->setArg(13, resultBuffer);
+        batchItemKernel->setArg(14, powersBuffer);
+        batchItemKernel->setArg(15, cl::Local(latticeSize * itemGroupSize));
+        batchItemKernel->setArg(16, numOptions);
+        batchItemKernel->setArg(17, maxNumNodes);
+        batchItemKernel->setArg(18, (int) isSmoothed());
+        batchItemKernel->setArg(19, (int) latticeModel);
+        queue->enqueueNDRangeKernel(*batchItemKernel,
+                                    cl::NullRange,
+                                    cl::NDRange(numWorkGroups * itemGroupSize),
+                                    cl::NDRange(itemGroupSize));
+    } else if (2 * latticeSize <= localMemSize) {
+        for (int i = 0; i < numColumns; i ++) {
+            batchLocalKernel->setArg(i, columns[i]);
+        }
+        batchLocalKernel->setArg(12, offsetsBuffer);
+        batchLocalKernel->setArg(13, resultBuffer);
+        batchLocalKernel->setArg(14, powersBuffer);
+        batchLocalKernel->setArg(15, cl::Local(2 * latticeSize));
+        batchLocalKernel->setArg(16, (int) isSmoothed());
+        batchLocalKernel->setArg(17, (int) latticeModel);
+        queue->enqueueNDRangeKernel(*batchLocalKernel,
+                                    cl::NullRange,
+                                    cl::NDRange(numOptions * groupSize),
+                                    cl::NDRange(groupSize));
+    } else {
+        cl::Buffer valueBuffer = acquire(job,
+                                         sizeof(Real) * totalNumLattice);
+        for (int i = 0; i < numColumns; i ++) {
+            batchKernel->setArg(i, columns[i]);
+        }
+        batchKernel->setArg(12, offsetsBuffer);
+        batchKernel->setArg(13, valueBuffer);
+        batchKernel->setArg(14, resultBuffer);
+        batchKernel->setArg(15, powersBuffer);
+        batchKernel->setArg(16, (int) isSmoothed());
+        batchKernel->setArg(17, (int) latticeModel);
+        queue->enqueueNDRangeKernel(*batchKernel,
+                                    cl::NullRange,
+                                    cl::NDRange(numOptions * groupSize),
+                                    cl::NDRange(groupSize));
+    }
+
+    return resultBuffer;
 }
 
 /**
@@ -106,198 +1130,513 @@ double OpenCLPricer::price(OptionSpec& optionSpec) {
  *      Kernel executed (optionSpec.numSteps) times
  *      Each execution reduces the number of lattice points by 1
  */
-double OpenCLPricer::priceImplGroup(OptionSpec& optionSpec, int groupSize) {
+template <typename Real>
+cl::Buffer OpenCLPricer::enqueueGroup(cl::CommandQueue* queue,
+                                      const OptionSpec& optionSpec,
+                                      int groupSize, PricingJob<Real>* job) {
     // ------------------------Derived Parameters------------------------------
-    float deltaT = optionSpec.yearsToMaturity / optionSpec.numSteps;
-
-    float upFactor = exp(optionSpec.volatility * sqrt(deltaT));
-    float downFactor = 1.0f / upFactor;
-
-    float discountFactor = exp(optionSpec.riskFreeRate * deltaT);
-
-    float upWeight = (discountFactor - downFactor) / (upFactor - downFactor);
-    float downWeight = 1.0f - upWeight;
+    // Shared by every option on the same tree, node price tables included
+    DeviceLattice lattice = deviceLattice<Real>(queue, optionSpec);
+    Real stockPrice = lattice.lattice->stockPrice;
+    Real deltaT = lattice.lattice->deltaT;
+    // Last time-step of a BBS lattice is one time-step before expiry
+    Real timeToExpiry = isSmoothed() ? deltaT : 0;
+    Real discountFactor = lattice.lattice->discountFactor;
+    Real upWeight = lattice.lattice->upWeight;
+    Real downWeight = lattice.lattice->downWeight;
     
-    // Create buffers on the devices
-    cl::Buffer valueBufferA(*context, 
-                           CL_MEM_READ_WRITE,
-                           sizeof(float) * (optionSpec.numSteps + 1));
+    // Acquire buffers on the devices
+    cl::Buffer valueBufferA = acquire(job,
+            sizeof(Real) * (optionSpec.numSteps + 1));
+    cl::Buffer valueBufferB = acquire(job,
+            sizeof(Real) * (optionSpec.numSteps + 1));
 
-    cl::Buffer valueBufferB(*context, 
-                           CL_MEM_READ_WRITE,
-                           sizeof(float) * (optionSpec.numSteps + 1));
+    cl::Buffer upPowersBuffer = lattice.upPowers;
+    cl::Buffer downPowersBuffer = lattice.downPowers;
+    cl::Buffer dividendEscrowsBuffer = uploadDividendEscrows(
+            queue, job, optionSpec, *lattice.lattice);
 
-    // Create qeueue to push commands for the devices
-    cl::CommandQueue queue(*context, *defaultDevice);
-    
-    // Build and run init kernel 
-    cl::Kernel initKernel(*program, "init");
-    initKernel.setArg(0, optionSpec.stockPrice);
-    initKernel.setArg(1, optionSpec.strikePrice);
-    initKernel.setArg(2, optionSpec.numSteps);
-    initKernel.setArg(3, optionSpec.type);
-    initKernel.setArg(4, deltaT);
-    initKernel.setArg(5, upFactor);
-    initKernel.setArg(6, downFactor);
-    initKernel.setArg(7, valueBufferA);
-    queue.enqueueNDRangeKernel(initKernel, 
-                              cl::NullRange, 
-                              cl::NDRange(optionSpec.numSteps + 1), 
-                              cl::NullRange);
+    // Run init kernel 
+    initKernel->setArg(0, stockPrice);
+    initKernel->setArg(1, (Real) optionSpec.strikePrice);
+    initKernel->setArg(2, optionSpec.numSteps);
+    initKernel->setArg(3, optionSpec.type);
+    initKernel->setArg(4, deltaT);
+    initKernel->setArg(5, upPowersBuffer);
+    initKernel->setArg(6, downPowersBuffer);
+    initKernel->setArg(7, valueBufferA);
+    initKernel->setArg(8, timeToExpiry);
+    initKernel->setArg(9, (Real) optionSpec.volatility);
+    initKernel->setArg(10, (Real) optionSpec.riskFreeRate);
+    initKernel->setArg(11, (int) optionSpec.isAmerican);
+    initKernel->setArg(12, (Real) optionSpec.dividendYield);
+    initKernel->setArg(13, dividendEscrowsBuffer);
+    queue->enqueueNDRangeKernel(*initKernel, 
+                                cl::NullRange, 
+                                cl::NDRange(optionSpec.numSteps + 1), 
+                                cl::NullRange);
     // std::cout << "[INFO] Executing init kernel with " << optionSpec.numSteps + 1
     //        << " work items" << std::endl;
 
     // Block until init kernel finishes execution
-    queue.enqueueBarrierWithWaitList();
+    queue->enqueueBarrierWithWaitList();
 
-    // Build and run group kernel 
-    cl::Kernel groupKernel(*program, "group");
-    groupKernel.setArg(0, upWeight);
-    groupKernel.setArg(1, downWeight);
-    groupKernel.setArg(2, discountFactor);
+    // Run group kernel 
+    groupKernel->setArg(0, upWeight);
+    groupKernel->setArg(1, downWeight);
+    groupKernel->setArg(2, discountFactor);
+    groupKernel->setArg(7, stockPrice);
+    groupKernel->setArg(8, (Real) optionSpec.strikePrice);
+    groupKernel->setArg(9, optionSpec.type);
+    groupKernel->setArg(10, upPowersBuffer);
+    groupKernel->setArg(11, downPowersBuffer);
+    groupKernel->setArg(12, (int) optionSpec.isAmerican);
+    groupKernel->setArg(13, dividendEscrowsBuffer);
     for (int i = 1; i <= optionSpec.numSteps; i ++) {
         int numLatticePoints = optionSpec.numSteps + 1 - i;
         int numWorkItems = ceil((float) numLatticePoints / groupSize);
-        groupKernel.setArg(3, i % 2 == 1 ? valueBufferA : valueBufferB);
-        groupKernel.setArg(4, i % 2 == 1 ? valueBufferB: valueBufferA);
-        groupKernel.setArg(5, numLatticePoints);
-        groupKernel.setArg(6, groupSize);
-        queue.enqueueNDRangeKernel(groupKernel,
-                            cl::NullRange,
-                            cl::NDRange(numWorkItems),
-                            cl::NullRange);
+        groupKernel->setArg(3, i % 2 == 1 ? valueBufferA : valueBufferB);
+        groupKernel->setArg(4, i % 2 == 1 ? valueBufferB: valueBufferA);
+        groupKernel->setArg(5, numLatticePoints);
+        groupKernel->setArg(6, groupSize);
+        queue->enqueueNDRangeKernel(*groupKernel,
+                                    cl::NullRange,
+                                    cl::NDRange(numWorkItems),
+                                    cl::NullRange);
 
         // std::cout << "[INFO] Executing group kernel with " << numWorkItems
         //         << " work items" << std::endl;
-        queue.enqueueBarrierWithWaitList();
+        queue->enqueueBarrierWithWaitList();
     }
 
-    // Read results
-    float* value = new float;
-    queue.enqueueReadBuffer(optionSpec.numSteps % 2 == 1? 
-                            valueBufferB : valueBufferA, 
-                            CL_TRUE, 
-                            0, 
-                            sizeof(float), 
-                            value);
-    return *value; 
+    // Result is in the buffer written by the last group kernel
+    return optionSpec.numSteps % 2 == 1 ? valueBufferB : valueBufferA;
 }
 
 
-double OpenCLPricer::priceImplTriangle(OptionSpec& optionSpec, int stepSize) {
-    if (stepSize >= 512) {
-        std::cerr << "[Error] Step size not valid."
-            << "Cannot have more than 512 work items per work group" 
-            << std::endl;
-        exit(5);
+template <typename Real>
+cl::Buffer OpenCLPricer::enqueueTriangle(cl::CommandQueue* queue,
+                                         const OptionSpec& optionSpec,
+                                         int stepSize, PricingJob<Real>* job,
+                                         cl::Buffer* nearRootBuffer) {
+    // Triangles larger than the device allows are shrunk to its limit
+    int maxStepSize = maxTriangleStepSize();
+    if (stepSize > maxStepSize) {
+        std::cout   << "[INFO] Step size " << stepSize
+                    << " exceeds the device limit, using " << maxStepSize
+                    << std::endl;
+        stepSize = maxStepSize;
     }
 
     // ------------------------Derived Parameters------------------------------
-    float deltaT = optionSpec.yearsToMaturity / optionSpec.numSteps;
-
-    float upFactor = exp(optionSpec.volatility * sqrt(deltaT));
-    float downFactor = 1.0f / upFactor;
-
-    float discountFactor = exp(optionSpec.riskFreeRate * deltaT);
-
-    float upWeight = (discountFactor - downFactor) / (upFactor - downFactor);
-    float downWeight = 1.0f - upWeight;
+    // Shared by every option on the same tree, node price tables included
+    DeviceLattice lattice = deviceLattice<Real>(queue, optionSpec);
+    Real stockPrice = lattice.lattice->stockPrice;
+    Real deltaT = lattice.lattice->deltaT;
+    // Last time-step of a BBS lattice is one time-step before expiry
+    Real timeToExpiry = isSmoothed() ? deltaT : 0;
+    Real discountFactor = lattice.lattice->discountFactor;
+    Real upWeight = lattice.lattice->upWeight;
+    Real downWeight = lattice.lattice->downWeight;
     
-    // Create buffers on the devices
-    cl::Buffer valueBuffer(*context, 
-                           CL_MEM_READ_WRITE,
-                           sizeof(float) * (optionSpec.numSteps + 1));
+    // Acquire buffers on the devices
+    cl::Buffer valueBuffer = acquire(job,
+            sizeof(Real) * (optionSpec.numSteps + 1));
+    cl::Buffer triangleBuffer = acquire(job,
+            sizeof(Real) * (optionSpec.numSteps + 1));
 
-    cl::Buffer triangleBuffer(*context, 
-                           CL_MEM_READ_WRITE,
-                           sizeof(float) * (optionSpec.numSteps + 1));
+    // Written by the last up triangle whether or not the caller asked for it
+    cl::Buffer nearRootValuesBuffer = acquire(job,
+            sizeof(Real) * NUM_NEAR_ROOT_VALUES);
+    if (nearRootBuffer != NULL) {
+        *nearRootBuffer = nearRootValuesBuffer;
+    }
 
-    // Create qeueue to push commands for the devices
-    cl::CommandQueue queue(*context, *defaultDevice);
-    
-    // Build and run init kernel 
-    cl::Kernel initKernel(*program, "init");
-    initKernel.setArg(0, optionSpec.stockPrice);
-    initKernel.setArg(1, optionSpec.strikePrice);
-    initKernel.setArg(2, optionSpec.numSteps);
-    initKernel.setArg(3, optionSpec.type);
-    initKernel.setArg(4, deltaT);
-    initKernel.setArg(5, upFactor);
-    initKernel.setArg(6, downFactor);
-    initKernel.setArg(7, valueBuffer);
-    queue.enqueueNDRangeKernel(initKernel, 
-                              cl::NullRange, 
-                              cl::NDRange(optionSpec.numSteps + 1), 
-                              cl::NullRange);
+    cl::Buffer upPowersBuffer = lattice.upPowers;
+    cl::Buffer downPowersBuffer = lattice.downPowers;
+    cl::Buffer dividendEscrowsBuffer = uploadDividendEscrows(
+            queue, job, optionSpec, *lattice.lattice);
+
+    // Run init kernel 
+    initKernel->setArg(0, stockPrice);
+    initKernel->setArg(1, (Real) optionSpec.strikePrice);
+    initKernel->setArg(2, optionSpec.numSteps);
+    initKernel->setArg(3, optionSpec.type);
+    initKernel->setArg(4, deltaT);
+    initKernel->setArg(5, upPowersBuffer);
+    initKernel->setArg(6, downPowersBuffer);
+    initKernel->setArg(7, valueBuffer);
+    initKernel->setArg(8, timeToExpiry);
+    initKernel->setArg(9, (Real) optionSpec.volatility);
+    initKernel->setArg(10, (Real) optionSpec.riskFreeRate);
+    initKernel->setArg(11, (int) optionSpec.isAmerican);
+    initKernel->setArg(12, (Real) optionSpec.dividendYield);
+    initKernel->setArg(13, dividendEscrowsBuffer);
+    queue->enqueueNDRangeKernel(*initKernel, 
+                                cl::NullRange, 
+                                cl::NDRange(optionSpec.numSteps + 1), 
+                                cl::NullRange);
     // std::cout << "[INFO] Executing init kernel with " << optionSpec.numSteps + 1
     //         << " work items" << std::endl;
 
     // Block until init kernel finishes execution
-    queue.enqueueBarrierWithWaitList();
+    queue->enqueueBarrierWithWaitList();
+
+    // Steps beyond a whole number of triangles are taken first, in a single
+    // trapezoid pass, leaving a lattice the triangles tile exactly
+    int numHeadSteps = optionSpec.numSteps % stepSize;
+    int numTriangleSteps = optionSpec.numSteps - numHeadSteps;
+    if (numHeadSteps > 0) {
+        cl::Buffer headBuffer = enqueueTrapezoidSteps(queue, optionSpec,
+                stockPrice, upWeight, downWeight, discountFactor,
+                upPowersBuffer, downPowersBuffer, dividendEscrowsBuffer,
+                valueBuffer, triangleBuffer,
+                optionSpec.numSteps, numHeadSteps, numHeadSteps);
+        if (headBuffer() != valueBuffer()) {
+            queue->enqueueCopyBuffer(headBuffer, valueBuffer, 0, 0,
+                                     sizeof(Real) * (numTriangleSteps + 1));
+        }
+    }
 
     // Note(disiok): Here we use work groups of size stepSize + 1 
     // so that after each iteration, the number of nodes is reduced by stepSize
     int groupSize = stepSize + 1;
 
-    cl::Kernel upKernel(*program, "upTriangle");
-    upKernel.setArg(0, upWeight);
-    upKernel.setArg(1, downWeight);
-    upKernel.setArg(2, discountFactor);
-    upKernel.setArg(3, valueBuffer);
-    upKernel.setArg(4, cl::Local(sizeof(float) * groupSize));
-    upKernel.setArg(5, triangleBuffer);
-
-    cl::Kernel downKernel(*program, "downTriangle");
-    downKernel.setArg(0, upWeight);
-    downKernel.setArg(1, downWeight);
-    downKernel.setArg(2, discountFactor);
-    downKernel.setArg(3, valueBuffer);
-    downKernel.setArg(4, cl::Local(sizeof(float) * groupSize));
-    downKernel.setArg(5, triangleBuffer);
-    for (int i = 0; i < optionSpec.numSteps / stepSize; i ++) {
-        int numWorkGroupsUp = optionSpec.numSteps / stepSize - i;
+    upKernel->setArg(0, upWeight);
+    upKernel->setArg(1, downWeight);
+    upKernel->setArg(2, discountFactor);
+    upKernel->setArg(3, valueBuffer);
+    upKernel->setArg(4, cl::Local(sizeof(Real) * groupSize));
+    upKernel->setArg(5, triangleBuffer);
+    upKernel->setArg(6, stockPrice);
+    upKernel->setArg(7, (Real) optionSpec.strikePrice);
+    upKernel->setArg(8, optionSpec.type);
+    upKernel->setArg(9, upPowersBuffer);
+    upKernel->setArg(10, downPowersBuffer);
+    upKernel->setArg(11, (int) optionSpec.isAmerican);
+    upKernel->setArg(13, nearRootValuesBuffer);
+    upKernel->setArg(14, dividendEscrowsBuffer);
+
+    downKernel->setArg(0, upWeight);
+    downKernel->setArg(1, downWeight);
+    downKernel->setArg(2, discountFactor);
+    downKernel->setArg(3, valueBuffer);
+    downKernel->setArg(4, cl::Local(sizeof(Real) * groupSize));
+    downKernel->setArg(5, triangleBuffer);
+    downKernel->setArg(6, stockPrice);
+    downKernel->setArg(7, (Real) optionSpec.strikePrice);
+    downKernel->setArg(8, optionSpec.type);
+    downKernel->setArg(9, upPowersBuffer);
+    downKernel->setArg(10, downPowersBuffer);
+    downKernel->setArg(11, (int) optionSpec.isAmerican);
+    downKernel->setArg(13, dividendEscrowsBuffer);
+    for (int i = 0; i < numTriangleSteps / stepSize; i ++) {
+        int numWorkGroupsUp = numTriangleSteps / stepSize - i;
         int numWorkGroupsDown = numWorkGroupsUp - 1;
         int numWorkItemsUp = numWorkGroupsUp * groupSize;
         int numWorkItemsDown = numWorkGroupsDown * groupSize;
 
-        queue.enqueueNDRangeKernel(upKernel,
-                            cl::NullRange,
-                            cl::NDRange(numWorkItemsUp)),
-                            cl::NDRange(groupSize);
+        // Time-step of the lattice points currently in the value buffer
+        int currentStep = numTriangleSteps - i * stepSize;
+        upKernel->setArg(12, currentStep);
+        downKernel->setArg(12, currentStep);
+
+        queue->enqueueNDRangeKernel(*upKernel,
+                                    cl::NullRange,
+                                    cl::NDRange(numWorkItemsUp),
+                                    cl::NDRange(groupSize));
         // std::cout << "[INFO] Executing up kernel with " << numWorkGroupsUp
         //         << " work groups and " << groupSize << " work items per group"
         //         << std::endl; 
 
-        queue.enqueueBarrierWithWaitList();
+        queue->enqueueBarrierWithWaitList();
 
         if (numWorkGroupsDown > 0) {
-            queue.enqueueNDRangeKernel(downKernel,
-                    cl::NullRange,
-                    cl::NDRange(numWorkItemsDown)),
-                    cl::NDRange(groupSize);
+            queue->enqueueNDRangeKernel(*downKernel,
+                                        cl::NullRange,
+                                        cl::NDRange(numWorkItemsDown),
+                                        cl::NDRange(groupSize));
             // std::cout << "[INFO] Executing down kernel with " << numWorkGroupsDown
             //     << " work groups and " << groupSize << " work items per group"
             //     << std::endl; 
-            queue.enqueueBarrierWithWaitList();
+            queue->enqueueBarrierWithWaitList();
         }
     }
 
-    // Read results
-    float* value = new float;
-    queue.enqueueReadBuffer(valueBuffer, 
-                            CL_TRUE, 
-                            0, 
-                            sizeof(float), 
-                            value);
-    return *value; 
+    return valueBuffer;
+}
+
+/**
+ * Algorithm:
+ *  init kernel:
+ *      Same as the group algorithm
+ *
+ *  trapezoid kernel:
+ *      Each work group loads a tile of the lattice plus a halo of
+ *      (stepsPerLaunch) points to its right into local memory, then iterates
+ *      (stepsPerLaunch) time-steps there with a barrier per step instead of
+ *      a kernel launch per step
+ *      The valid region shrinks by one point per step, so the halo is
+ *      recomputed redundantly by the neighbouring work group
+ *      Tiles are written to the other of two global buffers, as neighbouring
+ *      work groups still read them as halo
+ *      Kernel executed (optionSpec.numSteps / stepsPerLaunch) times, rounded up
+ */
+template <typename Real>
+cl::Buffer OpenCLPricer::enqueueTrapezoid(cl::CommandQueue* queue,
+                                          const OptionSpec& optionSpec,
+                                          int stepsPerLaunch,
+                                          PricingJob<Real>* job) {
+    // ------------------------Derived Parameters------------------------------
+    // Shared by every option on the same tree, node price tables included
+    DeviceLattice lattice = deviceLattice<Real>(queue, optionSpec);
+    Real stockPrice = lattice.lattice->stockPrice;
+    Real deltaT = lattice.lattice->deltaT;
+    // Last time-step of a BBS lattice is one time-step before expiry
+    Real timeToExpiry = isSmoothed() ? deltaT : 0;
+    Real discountFactor = lattice.lattice->discountFactor;
+    Real upWeight = lattice.lattice->upWeight;
+    Real downWeight = lattice.lattice->downWeight;
+
+    // Acquire buffers on the devices
+    cl::Buffer valueBufferA = acquire(job,
+            sizeof(Real) * (optionSpec.numSteps + 1));
+    cl::Buffer valueBufferB = acquire(job,
+            sizeof(Real) * (optionSpec.numSteps + 1));
+
+    cl::Buffer upPowersBuffer = lattice.upPowers;
+    cl::Buffer downPowersBuffer = lattice.downPowers;
+    cl::Buffer dividendEscrowsBuffer = uploadDividendEscrows(
+            queue, job, optionSpec, *lattice.lattice);
+
+    // Run init kernel 
+    initKernel->setArg(0, stockPrice);
+    initKernel->setArg(1, (Real) optionSpec.strikePrice);
+    initKernel->setArg(2, optionSpec.numSteps);
+    initKernel->setArg(3, optionSpec.type);
+    initKernel->setArg(4, deltaT);
+    initKernel->setArg(5, upPowersBuffer);
+    initKernel->setArg(6, downPowersBuffer);
+    initKernel->setArg(7, valueBufferA);
+    initKernel->setArg(8, timeToExpiry);
+    initKernel->setArg(9, (Real) optionSpec.volatility);
+    initKernel->setArg(10, (Real) optionSpec.riskFreeRate);
+    initKernel->setArg(11, (int) optionSpec.isAmerican);
+    initKernel->setArg(12, (Real) optionSpec.dividendYield);
+    initKernel->setArg(13, dividendEscrowsBuffer);
+    queue->enqueueNDRangeKernel(*initKernel, 
+                                cl::NullRange, 
+                                cl::NDRange(optionSpec.numSteps + 1), 
+                                cl::NullRange);
+
+    return enqueueTrapezoidSteps(queue, optionSpec, stockPrice, upWeight,
+                                 downWeight, discountFactor, upPowersBuffer,
+                                 downPowersBuffer, dividendEscrowsBuffer,
+                                 valueBufferA, valueBufferB,
+                                 optionSpec.numSteps, optionSpec.numSteps,
+                                 stepsPerLaunch);
+}
+
+/**
+ * Algorithm:
+ *  ladderInit kernel:
+ *      Use (optionSpec.numSteps + 1) work-items to compute the option values
+ *      of every strike at expiry, each from a single node price
+ *
+ *  ladder kernel:
+ *      Same tiling as the trapezoid kernel, with the option values of all
+ *      numStrikes strikes stored next to each other at every lattice point
+ *      Node prices and weights are loaded once per lattice point and reused
+ *      for every strike
+ *      Tiles shrink with numStrikes to fit in local memory, a quarter of
+ *      the points of a tile are spent on the halo
+ *      Results of the strikes are the first numStrikes values
+ */
+template <typename Real>
+cl::Buffer OpenCLPricer::enqueueLadder(cl::CommandQueue* queue,
+                                       const OptionSpec& optionSpec,
+                                       const float* strikePrices,
+                                       int numStrikes,
+                                       PricingJob<Real>* job) {
+    // ------------------------Derived Parameters------------------------------
+    DeviceLattice lattice = deviceLattice<Real>(queue, optionSpec);
+    Real stockPrice = lattice.lattice->stockPrice;
+    Real discountFactor = lattice.lattice->discountFactor;
+    Real upWeight = lattice.lattice->upWeight;
+    Real downWeight = lattice.lattice->downWeight;
+
+    int groupSize = std::min<int>(TRAPEZOID_GROUP_SIZE,
+            defaultDevice->getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>());
+    int maxLocalPoints = defaultDevice->getInfo<CL_DEVICE_LOCAL_MEM_SIZE>() /
+                         (2 * sizeof(Real) * numStrikes);
+    int stepsPerLaunch = std::max(1, maxLocalPoints / 4);
+    int tileSize = std::max(1, std::min(groupSize * TRAPEZOID_POINTS_PER_ITEM,
+                                        maxLocalPoints - stepsPerLaunch));
+
+    // Acquire buffers on the devices and upload strikes
+    std::vector<Real> strikes(strikePrices, strikePrices + numStrikes);
+    cl::Buffer strikesBuffer = upload(queue, job, strikes);
+    size_t latticeSize = sizeof(Real) * numStrikes * (optionSpec.numSteps + 1);
+    cl::Buffer valueBufferA = acquire(job, latticeSize);
+    cl::Buffer valueBufferB = acquire(job, latticeSize);
+    cl::Buffer dividendEscrowsBuffer = uploadDividendEscrows(
+            queue, job, optionSpec, *lattice.lattice);
+
+    // Run ladderInit kernel
+    ladderInitKernel->setArg(0, stockPrice);
+    ladderInitKernel->setArg(1, strikesBuffer);
+    ladderInitKernel->setArg(2, numStrikes);
+    ladderInitKernel->setArg(3, optionSpec.numSteps);
+    ladderInitKernel->setArg(4, optionSpec.type);
+    ladderInitKernel->setArg(5, lattice.upPowers);
+    ladderInitKernel->setArg(6, lattice.downPowers);
+    ladderInitKernel->setArg(7, valueBufferA);
+    queue->enqueueNDRangeKernel(*ladderInitKernel,
+                                cl::NullRange,
+                                cl::NDRange(optionSpec.numSteps + 1),
+                                cl::NullRange);
+
+    // Run ladder kernel, ordered by the in-order queue like the trapezoid
+    ladderKernel->setArg(0, upWeight);
+    ladderKernel->setArg(1, downWeight);
+    ladderKernel->setArg(2, discountFactor);
+    ladderKernel->setArg(5, cl::Local(2 * sizeof(Real) * numStrikes *
+                                      (tileSize + stepsPerLaunch)));
+    ladderKernel->setArg(8, tileSize);
+    ladderKernel->setArg(9, numStrikes);
+    ladderKernel->setArg(10, stockPrice);
+    ladderKernel->setArg(11, strikesBuffer);
+    ladderKernel->setArg(12, optionSpec.type);
+    ladderKernel->setArg(13, lattice.upPowers);
+    ladderKernel->setArg(14, lattice.downPowers);
+    ladderKernel->setArg(15, (int) optionSpec.isAmerican);
+    ladderKernel->setArg(16, dividendEscrowsBuffer);
+    int numLatticePoints = optionSpec.numSteps + 1;
+    bool isInA = true;
+    while (numLatticePoints > 1) {
+        int numTimeSteps = std::min(stepsPerLaunch, numLatticePoints - 1);
+        int numOutputs = numLatticePoints - numTimeSteps;
+        int numWorkGroups = (numOutputs + tileSize - 1) / tileSize;
+        ladderKernel->setArg(3, isInA ? valueBufferA : valueBufferB);
+        ladderKernel->setArg(4, isInA ? valueBufferB : valueBufferA);
+        ladderKernel->setArg(6, numLatticePoints);
+        ladderKernel->setArg(7, numTimeSteps);
+        queue->enqueueNDRangeKernel(*ladderKernel,
+                                    cl::NullRange,
+                                    cl::NDRange(numWorkGroups * groupSize),
+                                    cl::NDRange(groupSize));
+        numLatticePoints = numOutputs;
+        isInA = !isInA;
+    }
+
+    // Result is in the buffer written by the last ladder kernel
+    return isInA ? valueBufferA : valueBufferB;
+}
+
+/**
+ * Advances the lattice in valueBuffer, at time-step latticeStep, by
+ * numTimeSteps time-steps with the trapezoid kernel, using tempBuffer as the
+ * second buffer of the double buffered lattice
+ * Returns whichever of the two buffers the result ends up in
+ */
+template <typename Real>
+cl::Buffer OpenCLPricer::enqueueTrapezoidSteps(
+        cl::CommandQueue* queue,
+        const OptionSpec& optionSpec,
+        Real stockPrice,
+        Real upWeight, Real downWeight,
+        Real discountFactor,
+        const cl::Buffer& upPowers,
+        const cl::Buffer& downPowers,
+        const cl::Buffer& dividendEscrows,
+        const cl::Buffer& valueBuffer,
+        const cl::Buffer& tempBuffer,
+        int latticeStep,
+        int numTimeSteps,
+        int stepsPerLaunch) {
+    // Tile and halo are double buffered in local memory, shrink the tile and
+    // then the steps per launch until they fit
+    int groupSize = std::min<int>(TRAPEZOID_GROUP_SIZE,
+            defaultDevice->getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>());
+    int maxLocalPoints =
+        defaultDevice->getInfo<CL_DEVICE_LOCAL_MEM_SIZE>() / (2 * sizeof(Real));
+    int tileSize = groupSize * TRAPEZOID_POINTS_PER_ITEM;
+    while (tileSize > groupSize && tileSize + stepsPerLaunch > maxLocalPoints) {
+        tileSize /= 2;
+    }
+    stepsPerLaunch = std::max(1, std::min(stepsPerLaunch,
+                                          maxLocalPoints - tileSize));
+
+    // NOTE(disiok): The queue is in-order, so each launch already sees the
+    // lattice written by the previous one without a barrier in between
+    trapezoidKernel->setArg(0, upWeight);
+    trapezoidKernel->setArg(1, downWeight);
+    trapezoidKernel->setArg(2, discountFactor);
+    trapezoidKernel->setArg(5,
+            cl::Local(2 * sizeof(Real) * (tileSize + stepsPerLaunch)));
+    trapezoidKernel->setArg(8, tileSize);
+    trapezoidKernel->setArg(9, stockPrice);
+    trapezoidKernel->setArg(10, (Real) optionSpec.strikePrice);
+    trapezoidKernel->setArg(11, optionSpec.type);
+    trapezoidKernel->setArg(12, upPowers);
+    trapezoidKernel->setArg(13, downPowers);
+    trapezoidKernel->setArg(14, (int) optionSpec.isAmerican);
+    trapezoidKernel->setArg(15, dividendEscrows);
+    int numLatticePoints = latticeStep + 1;
+    int finalNumLatticePoints = numLatticePoints - numTimeSteps;
+    bool isInValueBuffer = true;
+    while (numLatticePoints > finalNumLatticePoints) {
+        int launchSteps = std::min(stepsPerLaunch,
+                                   numLatticePoints - finalNumLatticePoints);
+        int numOutputs = numLatticePoints - launchSteps;
+        int numWorkGroups = (numOutputs + tileSize - 1) / tileSize;
+        trapezoidKernel->setArg(3, isInValueBuffer ? valueBuffer : tempBuffer);
+        trapezoidKernel->setArg(4, isInValueBuffer ? tempBuffer : valueBuffer);
+        trapezoidKernel->setArg(6, numLatticePoints);
+        trapezoidKernel->setArg(7, launchSteps);
+        queue->enqueueNDRangeKernel(*trapezoidKernel,
+                                    cl::NullRange,
+                                    cl::NDRange(numWorkGroups * groupSize),
+                                    cl::NDRange(groupSize));
+        numLatticePoints = numOutputs;
+        isInValueBuffer = !isInValueBuffer;
+    }
+
+    // Result is in the buffer written by the last trapezoid kernel
+    return isInValueBuffer ? valueBuffer : tempBuffer;
 }
 
 // -------------------------Destructor-----------------------------------------
 OpenCLPricer::~OpenCLPricer() {
+    // Wait for the callbacks of asynchronous calls, they use the buffer pool
+    for (size_t i = 0; i < asyncQueues.size(); i ++) {
+        asyncQueues[i]->finish();
+    }
+    while (numPendingJobs > 0) {
+        std::this_thread::yield();
+    }
+    for (size_t i = 0; i < asyncQueues.size(); i ++) {
+        delete asyncQueues[i];
+    }
+
+    deviceLattices.clear();
+    delete tuningTable;
+    delete bufferPool;
+    delete impliedVolatilityKernel;
+    delete batchItemKernel;
+    delete batchLocalKernel;
+    delete batchKernel;
+    delete downKernel;
+    delete upKernel;
+    delete ladderKernel;
+    delete ladderInitKernel;
+    delete trapezoidKernel;
+    delete groupKernel;
+    delete initKernel;
+    delete queue;
     delete platforms;
     delete devices;
     delete context;
     delete kernelCode;
-    delete sources;
     delete program;
 }
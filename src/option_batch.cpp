@@ -0,0 +1,87 @@
+// System Libraries
+#include <vector>
+#include <algorithm>
+
+#include "option_spec.h"
+#include "option_batch.h"
+
+OptionBatch::OptionBatch(const std::vector<OptionSpec>& optionSpecs) {
+    reserve(optionSpecs.size());
+    for (size_t i = 0; i < optionSpecs.size(); i ++) {
+        push_back(optionSpecs[i]);
+    }
+}
+
+void OptionBatch::reserve(size_t size) {
+    type.reserve(size);
+    stockPrice.reserve(size);
+    strikePrice.reserve(size);
+    yearsToMaturity.reserve(size);
+    volatility.reserve(size);
+    riskFreeRate.reserve(size);
+    numSteps.reserve(size);
+    isAmerican.reserve(size);
+    dividendYield.reserve(size);
+    numDividends.reserve(size);
+    dividendTimes.reserve(MAX_DIVIDENDS * size);
+    dividendAmounts.reserve(MAX_DIVIDENDS * size);
+}
+
+void OptionBatch::push_back(const OptionSpec& optionSpec) {
+    type.push_back(optionSpec.type);
+    stockPrice.push_back(optionSpec.stockPrice);
+    strikePrice.push_back(optionSpec.strikePrice);
+    yearsToMaturity.push_back(optionSpec.yearsToMaturity);
+    volatility.push_back(optionSpec.volatility);
+    riskFreeRate.push_back(optionSpec.riskFreeRate);
+    numSteps.push_back(optionSpec.numSteps);
+    isAmerican.push_back(optionSpec.isAmerican ? 1 : 0);
+    dividendYield.push_back(optionSpec.dividendYield);
+    numDividends.push_back(optionSpec.numDividends);
+    dividendTimes.insert(dividendTimes.end(), optionSpec.dividendTimes,
+                         optionSpec.dividendTimes + MAX_DIVIDENDS);
+    dividendAmounts.insert(dividendAmounts.end(), optionSpec.dividendAmounts,
+                           optionSpec.dividendAmounts + MAX_DIVIDENDS);
+}
+
+OptionSpec OptionBatch::operator[](size_t i) const {
+    OptionSpec optionSpec(type[i], stockPrice[i], strikePrice[i],
+                          yearsToMaturity[i], volatility[i], riskFreeRate[i],
+                          numSteps[i], isAmerican[i] != 0, dividendYield[i]);
+    optionSpec.numDividends = numDividends[i];
+    std::copy(dividendTimes.begin() + MAX_DIVIDENDS * i,
+              dividendTimes.begin() + MAX_DIVIDENDS * (i + 1),
+              optionSpec.dividendTimes);
+    std::copy(dividendAmounts.begin() + MAX_DIVIDENDS * i,
+              dividendAmounts.begin() + MAX_DIVIDENDS * (i + 1),
+              optionSpec.dividendAmounts);
+    return optionSpec;
+}
+
+OptionBatch OptionBatch::slice(size_t first, size_t last) const {
+    OptionBatch batch;
+    batch.type.assign(type.begin() + first, type.begin() + last);
+    batch.stockPrice.assign(stockPrice.begin() + first,
+                            stockPrice.begin() + last);
+    batch.strikePrice.assign(strikePrice.begin() + first,
+                             strikePrice.begin() + last);
+    batch.yearsToMaturity.assign(yearsToMaturity.begin() + first,
+                                 yearsToMaturity.begin() + last);
+    batch.volatility.assign(volatility.begin() + first,
+                            volatility.begin() + last);
+    batch.riskFreeRate.assign(riskFreeRate.begin() + first,
+                              riskFreeRate.begin() + last);
+    batch.numSteps.assign(numSteps.begin() + first, numSteps.begin() + last);
+    batch.isAmerican.assign(isAmerican.begin() + first,
+                            isAmerican.begin() + last);
+    batch.dividendYield.assign(dividendYield.begin() + first,
+                               dividendYield.begin() + last);
+    batch.numDividends.assign(numDividends.begin() + first,
+                              numDividends.begin() + last);
+    batch.dividendTimes.assign(dividendTimes.begin() + MAX_DIVIDENDS * first,
+                               dividendTimes.begin() + MAX_DIVIDENDS * last);
+    batch.dividendAmounts.assign(
+            dividendAmounts.begin() + MAX_DIVIDENDS * first,
+            dividendAmounts.begin() + MAX_DIVIDENDS * last);
+    return batch;
+}
@@ -0,0 +1,86 @@
+#ifndef __OPTION_BATCH_H__
+#define __OPTION_BATCH_H__
+// System Libraries
+#include <vector>
+#include <cstdlib>
+#include <new>
+
+#include "option_spec.h"
+
+// Alignment of OptionBatch columns in bytes, a cache line and an AVX-512
+// vector
+#define OPTION_BATCH_ALIGNMENT 64
+
+// Allocator handing out storage aligned to OPTION_BATCH_ALIGNMENT
+template <typename T>
+struct AlignedAllocator {
+    typedef T value_type;
+
+    AlignedAllocator() {}
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        void* data = NULL;
+        if (posix_memalign(&data, OPTION_BATCH_ALIGNMENT,
+                           n * sizeof(T)) != 0) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(data);
+    }
+    void deallocate(T* data, size_t) {
+        free(data);
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const AlignedAllocator<T>&, const AlignedAllocator<U>&) {
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const AlignedAllocator<T>&, const AlignedAllocator<U>&) {
+    return false;
+}
+
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T> >;
+
+/**
+ * Options stored as one aligned column per OptionSpec field
+ *
+ * Columns can be loaded with vector instructions and uploaded to a device
+ * with one buffer copy each, without gathering fields option by option.
+ */
+struct OptionBatch {
+    OptionBatch() {}
+    explicit OptionBatch(const std::vector<OptionSpec>& optionSpecs);
+
+    size_t size() const {
+        return type.size();
+    }
+    void reserve(size_t size);
+    void push_back(const OptionSpec& optionSpec);
+    // Option i gathered back into an OptionSpec
+    OptionSpec operator[](size_t i) const;
+    // Options first to last - 1 as a batch of their own
+    OptionBatch slice(size_t first, size_t last) const;
+
+    AlignedVector<int> type;
+    AlignedVector<float> stockPrice;
+    AlignedVector<float> strikePrice;
+    AlignedVector<float> yearsToMaturity;
+    AlignedVector<float> volatility;
+    AlignedVector<float> riskFreeRate;
+    AlignedVector<int> numSteps;
+    // 1 for American and 0 for European exercise, an int so that the column
+    // uploads as is
+    AlignedVector<int> isAmerican;
+    AlignedVector<float> dividendYield;
+    AlignedVector<int> numDividends;
+    // MAX_DIVIDENDS entries per option, of which the first numDividends are
+    // the discrete dividends of the option
+    AlignedVector<float> dividendTimes;
+    AlignedVector<float> dividendAmounts;
+};
+#endif
@@ -0,0 +1,124 @@
+#include <vector>
+#include <future>
+
+#include "option_spec.h"
+#include "option_batch.h"
+#include "pricer.h"
+#include "black_scholes.h"
+#include "implied_volatility.h"
+
+void OptionPricer::price(const std::vector<OptionSpec>& optionSpecs,
+                         std::vector<double>& prices) {
+    price(OptionBatch(optionSpecs), prices);
+}
+
+void OptionPricer::priceLadder(const OptionSpec& optionSpec,
+                               const std::vector<float>& strikePrices,
+                               std::vector<double>& prices) {
+    OptionBatch optionBatch;
+    optionBatch.reserve(strikePrices.size());
+    OptionSpec strikeSpec = optionSpec;
+    for (size_t i = 0; i < strikePrices.size(); i ++) {
+        strikeSpec.strikePrice = strikePrices[i];
+        optionBatch.push_back(strikeSpec);
+    }
+    price(optionBatch, prices);
+}
+
+/**
+ * Central differences in the stock price and a backward difference of one
+ * day in the maturity, pricing the option four times
+ */
+OptionGreeks OptionPricer::priceWithGreeks(const OptionSpec& optionSpec) {
+    OptionSpec bumpedSpec = optionSpec;
+    OptionGreeks greeks;
+    greeks.price = price(bumpedSpec);
+
+    // Bumps are measured after rounding to the float fields
+    bumpedSpec.stockPrice = optionSpec.stockPrice * 1.01f;
+    double upBump = bumpedSpec.stockPrice - optionSpec.stockPrice;
+    double upPrice = price(bumpedSpec);
+    bumpedSpec.stockPrice = optionSpec.stockPrice * 0.99f;
+    double downBump = optionSpec.stockPrice - bumpedSpec.stockPrice;
+    double downPrice = price(bumpedSpec);
+    greeks.delta = (upPrice - downPrice) / (upBump + downBump);
+    greeks.gamma = ((upPrice - greeks.price) / upBump -
+                    (greeks.price - downPrice) / downBump) /
+                   (0.5 * (upBump + downBump));
+
+    bumpedSpec.stockPrice = optionSpec.stockPrice;
+    bumpedSpec.yearsToMaturity = optionSpec.yearsToMaturity - 1.0f / 365;
+    double timeBump = optionSpec.yearsToMaturity - bumpedSpec.yearsToMaturity;
+    greeks.theta = (price(bumpedSpec) - greeks.price) / timeBump;
+    return greeks;
+}
+
+/**
+ * Each iteration prices every unconverged option at its volatility and at
+ * the bumped volatility of its vega in a single batch, starting from the
+ * Black-Scholes estimate
+ */
+void OptionPricer::impliedVolatility(const OptionBatch& optionBatch,
+                                     const std::vector<double>& marketPrices,
+                                     std::vector<double>& volatilities) {
+    std::vector<VolatilitySearch> searches;
+    std::vector<size_t> unconverged;
+    for (size_t i = 0; i < optionBatch.size(); i ++) {
+        searches.push_back(VolatilitySearch(blackScholesVolatilityEstimate(
+                optionBatch[i], marketPrices[i])));
+        unconverged.push_back(i);
+    }
+
+    std::vector<double> prices;
+    for (int iteration = 0;
+         iteration < IMPLIED_VOLATILITY_MAX_ITERATIONS && !unconverged.empty();
+         iteration ++) {
+        OptionBatch trialBatch;
+        trialBatch.reserve(2 * unconverged.size());
+        for (size_t k = 0; k < unconverged.size(); k ++) {
+            OptionSpec trialSpec = optionBatch[unconverged[k]];
+            trialSpec.volatility = searches[unconverged[k]].volatility;
+            trialBatch.push_back(trialSpec);
+            trialSpec.volatility += IMPLIED_VOLATILITY_BUMP;
+            trialBatch.push_back(trialSpec);
+        }
+        price(trialBatch, prices);
+
+        std::vector<size_t> stillUnconverged;
+        for (size_t k = 0; k < unconverged.size(); k ++) {
+            // Volatilities are those priced, after rounding to float
+            VolatilitySearch& search = searches[unconverged[k]];
+            search.volatility = trialBatch.volatility[2 * k];
+            double vega = (prices[2 * k + 1] - prices[2 * k]) /
+                          (trialBatch.volatility[2 * k + 1] -
+                           trialBatch.volatility[2 * k]);
+            search.step(prices[2 * k], vega, marketPrices[unconverged[k]]);
+            if (!search.isConverged) {
+                stillUnconverged.push_back(unconverged[k]);
+            }
+        }
+        unconverged.swap(stillUnconverged);
+    }
+
+    volatilities.resize(optionBatch.size());
+    for (size_t i = 0; i < optionBatch.size(); i ++) {
+        volatilities[i] = searches[i].result();
+    }
+}
+
+std::future<double> OptionPricer::priceAsync(const OptionSpec& optionSpec) {
+    // price() takes a mutable spec, so the thread works on its own copy
+    OptionSpec spec = optionSpec;
+    return std::async(std::launch::async, [this, spec]() mutable {
+        return price(spec);
+    });
+}
+
+std::future<std::vector<double> > OptionPricer::priceAsync(
+        const std::vector<OptionSpec>& optionSpecs) {
+    return std::async(std::launch::async, [this, optionSpecs]() {
+        std::vector<double> prices;
+        price(optionSpecs, prices);
+        return prices;
+    });
+}
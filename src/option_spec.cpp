@@ -1,6 +1,64 @@
 #include <iostream>
+#include <cmath>
 #include "option_spec.h"
 
+OptionSpec::OptionSpec(): type(0), stockPrice(0), strikePrice(0),
+                          yearsToMaturity(0), volatility(0), riskFreeRate(0),
+                          numSteps(0), isAmerican(false), dividendYield(0),
+                          numDividends(0), dividendTimes(),
+                          dividendAmounts() {
+}
+
+OptionSpec::OptionSpec(int type, float stockPrice, float strikePrice,
+                       float yearsToMaturity, float volatility,
+                       float riskFreeRate, int numSteps, bool isAmerican,
+                       float dividendYield):
+    type(type), stockPrice(stockPrice), strikePrice(strikePrice),
+    yearsToMaturity(yearsToMaturity), volatility(volatility),
+    riskFreeRate(riskFreeRate), numSteps(numSteps), isAmerican(isAmerican),
+    dividendYield(dividendYield), numDividends(0), dividendTimes(),
+    dividendAmounts() {
+}
+
+bool OptionSpec::addDividend(float time, float amount) {
+    if (numDividends >= MAX_DIVIDENDS) {
+        std::cerr   << "[ERROR] More than " << MAX_DIVIDENDS
+                    << " dividends" << std::endl;
+        return false;
+    }
+    dividendTimes[numDividends] = time;
+    dividendAmounts[numDividends] = amount;
+    numDividends ++;
+    return true;
+}
+
+double dividendEscrow(const OptionSpec& optionSpec, double time) {
+    double escrow = 0;
+    for (int i = 0; i < optionSpec.numDividends && i < MAX_DIVIDENDS; i ++) {
+        double dividendTime = optionSpec.dividendTimes[i];
+        if (dividendTime > time) {
+            escrow += optionSpec.dividendAmounts[i] *
+                      exp(-optionSpec.riskFreeRate * (dividendTime - time));
+        }
+    }
+    return escrow;
+}
+
+OptionSpec dividendsToMaturity(const OptionSpec& optionSpec) {
+    OptionSpec spec = optionSpec;
+    spec.numDividends = 0;
+    for (int i = 0; i < optionSpec.numDividends && i < MAX_DIVIDENDS; i ++) {
+        float dividendTime = optionSpec.dividendTimes[i];
+        if (dividendTime > 0 && dividendTime <= optionSpec.yearsToMaturity) {
+            spec.dividendTimes[spec.numDividends] = dividendTime;
+            spec.dividendAmounts[spec.numDividends] =
+                optionSpec.dividendAmounts[i];
+            spec.numDividends ++;
+        }
+    }
+    return spec;
+}
+
 std::ostream& operator<<(std::ostream& os, const OptionSpec& other) {
     os << "Option Pricing Specification" << std::endl;
     os << "------------------------------" << std::endl;
@@ -12,6 +70,11 @@ std::ostream& operator<<(std::ostream& os, const OptionSpec& other) {
     os << "Volatility: " << other.volatility << std::endl;
     os << "Risk Free Rate: " << other.riskFreeRate << std::endl;
     os << "Number of Steps: " << other.numSteps << std::endl; 
+    os << "Dividend Yield: " << other.dividendYield << std::endl;
+    for (int i = 0; i < other.numDividends && i < MAX_DIVIDENDS; i ++) {
+        os << "Dividend: " << other.dividendAmounts[i] << " at "
+           << other.dividendTimes[i] << std::endl;
+    }
     os << "------------------------------" << std::endl;
     return os;
 }
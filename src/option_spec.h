@@ -1,7 +1,19 @@
 #ifndef __OPTION_SPEC_H__
 #define __OPTION_SPEC_H__
 #include <iostream>
+
+// Most discrete dividends of an option
+#define MAX_DIVIDENDS 8
+
 struct OptionSpec {
+    // Every field zero, without dividends
+    OptionSpec();
+    OptionSpec(int type, float stockPrice, float strikePrice,
+               float yearsToMaturity, float volatility, float riskFreeRate,
+               int numSteps, bool isAmerican, float dividendYield = 0);
+    // Appends a discrete dividend, false when MAX_DIVIDENDS are already set
+    bool addDividend(float time, float amount);
+
     /**
      * Type of option:
      *      1  -> Call option
@@ -14,8 +26,37 @@ struct OptionSpec {
     float volatility;
     float riskFreeRate;
     int numSteps;   
-    //TODO(disiok): Implement for OpenCL pricers
     bool isAmerican;
+    // Continuous dividend yield, or the foreign interest rate of an FX option
+    float dividendYield;
+    /**
+     * Discrete cash dividends of dividendAmounts paid at dividendTimes, in
+     * years from now, the first numDividends of them
+     * Priced with the escrowed dividend model: the lattice models the stock
+     * price net of the present value of the dividends still to be paid, so
+     * that it stays recombining, and early exercise adds that value back
+     */
+    int numDividends;
+    float dividendTimes[MAX_DIVIDENDS];
+    float dividendAmounts[MAX_DIVIDENDS];
+};
+
+// Price of an option with its sensitivities
+struct OptionGreeks {
+    double price;
+    // First and second derivatives by the stock price
+    double delta;
+    double gamma;
+    // Derivative by the passing of time, per year
+    double theta;
 };
+// Present value at time of the discrete dividends of optionSpec paid after
+// time, zero without any
+double dividendEscrow(const OptionSpec& optionSpec, double time);
+
+// optionSpec without the discrete dividends paid outside
+// (0, yearsToMaturity], which make no difference to the option
+OptionSpec dividendsToMaturity(const OptionSpec& optionSpec);
+
 std::ostream& operator<<(std::ostream& out, const OptionSpec& other);
 #endif
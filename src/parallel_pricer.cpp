@@ -0,0 +1,306 @@
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+
+#include "option_spec.h"
+#include "option_batch.h"
+#include "pricer.h"
+#include "lattice_kernels.h"
+#include "lattice_cache.h"
+#include "black_scholes.h"
+
+// Reusable barrier for the worker threads of a single pricing call
+class ThreadBarrier {
+public:
+    ThreadBarrier(int numThreads): numThreads(numThreads), numWaiting(0),
+                                   generation(0) {}
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        int currentGeneration = generation;
+        if (++numWaiting == numThreads) {
+            numWaiting = 0;
+            generation++;
+            condition.notify_all();
+        } else {
+            condition.wait(lock, [&] { return generation != currentGeneration; });
+        }
+    }
+private:
+    std::mutex mutex;
+    std::condition_variable condition;
+    int numThreads;
+    int numWaiting;
+    int generation;
+};
+
+// Constants of the lattice shared by every worker thread
+struct LatticeParams {
+    // Net of the discrete dividends
+    double stockPrice;
+    double upFactor;
+    double downFactor;
+    double discountFactor;
+    // Risk neutral weights with the discounting folded in
+    double upWeight;
+    double downWeight;
+};
+
+static LatticeParams deriveParams(const Lattice& lattice) {
+    LatticeParams params;
+    params.stockPrice = lattice.stockPrice;
+    params.upFactor = lattice.upFactor;
+    params.downFactor = lattice.downFactor;
+    params.discountFactor = lattice.discountFactor;
+    params.upWeight = lattice.upWeight / params.discountFactor;
+    params.downWeight = lattice.downWeight / params.discountFactor;
+    return params;
+}
+
+/**
+ * Node prices of numNodes points starting at index for the given time-step
+ * Carried over from the previous time-step when stepsTaken > 0, and only
+ * recomputed from scratch every NODE_PRICE_ANCHOR time-steps
+ */
+static void advanceNodePrices(const LatticeParams& params,
+                              double* nodePrice, int index, int numNodes,
+                              int step, int stepsTaken) {
+    if (stepsTaken % NODE_PRICE_ANCHOR == 0) {
+        nodePrices(nodePrice, params.stockPrice, params.upFactor,
+                   params.downFactor, step, index, numNodes);
+    } else {
+        previousNodePrices(nodePrice, numNodes, params.downFactor);
+    }
+}
+
+// Iterates the lattice backwards by one time-step starting at currentStep
+static void backwardStep(const OptionSpec& optionSpec,
+                         const Lattice& lattice,
+                         const LatticeParams& params,
+                         std::vector<double>& optionValue,
+                         std::vector<double>& nodePrice, int currentStep) {
+    backwardInduction(&optionValue[0], currentStep,
+                      params.upWeight, params.downWeight);
+    if (optionSpec.isAmerican) {
+        advanceNodePrices(params, &nodePrice[0], 0, currentStep,
+                          currentStep - 1, optionSpec.numSteps - currentStep);
+        exerciseValue(&optionValue[0], &nodePrice[0], currentStep,
+                      optionSpec.type,
+                      lattice.exerciseStrike(optionSpec, currentStep - 1));
+    }
+}
+
+ParallelPricer::ParallelPricer(int numThreads, int stepSize):
+    numThreads(numThreads), stepSize(stepSize) {
+    if (this->numThreads <= 0) {
+        this->numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    latticeCache = new LatticeCache();
+}
+
+ParallelPricer::~ParallelPricer() {
+    delete latticeCache;
+}
+
+OptionGreeks ParallelPricer::priceWithGreeks(const OptionSpec& optionSpec) {
+    SerialPricer serialPricer(latticeCache);
+    serialPricer.setConvergenceMode(convergenceMode);
+    serialPricer.setLatticeModel(latticeModel);
+    return serialPricer.priceWithGreeks(optionSpec);
+}
+
+/**
+ * Algorithm:
+ *  Same tiling as the upTriangle and downTriangle kernels, with each thread
+ *  owning a contiguous range of tiles of (stepSize + 1) lattice points
+ *
+ *  up phase:
+ *      Each tile iterates stepSize time-steps in a private buffer, shrinking
+ *      to a triangle. Its left edge is stored in the triangle buffer and its
+ *      right edge back into the lattice
+ *
+ *  down phase:
+ *      Each tile fills the inverted triangle between its right edge and the
+ *      left edge of the next tile
+ *
+ *  Threads only synchronize at the end of each phase, so there are two
+ *  barriers per stepSize time-steps instead of one per time-step
+ *
+ *  Tiles follow the dependencies of binomial lattices, trinomial lattices
+ *  are priced by a single serial pricer
+ */
+double ParallelPricer::priceLattice(OptionSpec& optionSpec) {
+    if (latticeModel == LATTICE_TRINOMIAL) {
+        SerialPricer serialPricer(latticeCache);
+        serialPricer.setConvergenceMode(convergenceMode);
+        serialPricer.setLatticeModel(latticeModel);
+        return serialPricer.priceLattice(optionSpec);
+    }
+
+    std::shared_ptr<const Lattice> lattice = latticeCache->get(optionSpec,
+                                                               latticeModel);
+    LatticeParams params = deriveParams(*lattice);
+    int numSteps = optionSpec.numSteps;
+
+    // -----------------Calculate option value at expiry-----------------------
+    std::vector<double> optionValue(numSteps + 1);
+    std::vector<double> nodePrice(numSteps + 1);
+    double expiryStrike = lattice->exerciseStrike(optionSpec, numSteps);
+    for (int i = 0; i <= numSteps; ++i) {
+        // Last time-step of a BBS lattice is one time-step before expiry
+        if (isSmoothed()) {
+            optionValue[i] = blackScholesNodeValue(optionSpec,
+                                                   lattice->terminalPrices[i],
+                                                   lattice->deltaT,
+                                                   expiryStrike);
+        } else {
+            optionValue[i] = std::max(optionSpec.type *
+                                      (lattice->terminalPrices[i] -
+                                       optionSpec.strikePrice),
+                                      0.0);
+        }
+    }
+
+    // Iterate the remainder time-steps so that the tiles divide the lattice
+    int currentStep = numSteps;
+    while (currentStep % stepSize != 0) {
+        backwardStep(optionSpec, *lattice, params, optionValue, nodePrice,
+                     currentStep);
+        currentStep--;
+    }
+    if (currentStep == 0) {
+        return optionValue[0];
+    }
+
+    // ----------------Iterate backwards tile by tile--------------------------
+    std::vector<double> triangle(numSteps + 1);
+    int numWorkers = std::min(numThreads, currentStep / stepSize);
+    ThreadBarrier barrier(numWorkers);
+
+    auto worker = [&](int workerId) {
+        std::vector<double> tempOptionValue(stepSize + 1);
+        std::vector<double> tempNodePrice(stepSize + 1);
+        for (int step = currentStep; step > 0; step -= stepSize) {
+            int numTiles = step / stepSize;
+            int firstTile = numTiles * workerId / numWorkers;
+            int lastTile = numTiles * (workerId + 1) / numWorkers;
+
+            // Up phase
+            for (int tile = firstTile; tile < lastTile; tile++) {
+                int offset = tile * stepSize;
+                for (int j = 0; j <= stepSize; j++) {
+                    tempOptionValue[j] = optionValue[offset + j];
+                }
+                for (int i = 1; i <= stepSize; i++) {
+                    backwardInduction(&tempOptionValue[0], stepSize - i + 1,
+                                      params.upWeight, params.downWeight);
+                    if (optionSpec.isAmerican) {
+                        advanceNodePrices(params, &tempNodePrice[0],
+                                          offset, stepSize - i + 1, step - i,
+                                          i - 1);
+                        exerciseValue(&tempOptionValue[0], &tempNodePrice[0],
+                                      stepSize - i + 1, optionSpec.type,
+                                      lattice->exerciseStrike(optionSpec,
+                                                              step - i));
+                    }
+                    triangle[offset + i] = tempOptionValue[0];
+                    if (i < stepSize) {
+                        optionValue[offset + stepSize - i] =
+                            tempOptionValue[stepSize - i];
+                    }
+                }
+                if (tile == 0) {
+                    optionValue[0] = tempOptionValue[0];
+                }
+            }
+            barrier.wait();
+
+            // Down phase, the last tile has no neighbour to fill against
+            lastTile = std::min(lastTile, numTiles - 1);
+            for (int tile = firstTile; tile < lastTile; tile++) {
+                int offset = tile * stepSize;
+                for (int i = 1; i <= stepSize - 1; i++) {
+                    // Bring in the right edge of this tile and the left edge
+                    // of the next one so the step runs over contiguous points
+                    tempOptionValue[stepSize - i] =
+                        optionValue[offset + stepSize - i];
+                    tempOptionValue[stepSize] = triangle[offset + stepSize + i];
+                    backwardInduction(&tempOptionValue[stepSize - i], i,
+                                      params.upWeight, params.downWeight);
+                    if (optionSpec.isAmerican) {
+                        // Prices cover the whole tile so they can be carried
+                        // over as the inverted triangle widens
+                        advanceNodePrices(params, &tempNodePrice[0],
+                                          offset, stepSize, step - i - 1,
+                                          i - 1);
+                        exerciseValue(&tempOptionValue[stepSize - i],
+                                      &tempNodePrice[stepSize - i], i,
+                                      optionSpec.type,
+                                      lattice->exerciseStrike(optionSpec,
+                                                              step - i - 1));
+                    }
+                }
+                for (int j = 1; j < stepSize; j++) {
+                    optionValue[offset + j] = tempOptionValue[j];
+                }
+                optionValue[offset + stepSize] = triangle[offset + 2 * stepSize];
+            }
+            barrier.wait();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < numWorkers; i++) {
+        threads.push_back(std::thread(worker, i));
+    }
+    worker(0);
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+    return optionValue[0];
+}
+
+/**
+ * Prices the batch with one serial lattice per option, handing chunks of
+ * options out to the worker threads as they become free
+ */
+void ParallelPricer::priceLattice(const OptionBatch& optionBatch,
+                                  std::vector<double>& prices) {
+    // Options handed to a worker at a time, sharing its lattice buffers
+    const int chunkSize = 16;
+    prices.resize(optionBatch.size());
+    int numOptions = optionBatch.size();
+    std::atomic<int> nextOption(0);
+
+    auto worker = [&]() {
+        SerialPricer serialPricer(latticeCache);
+        serialPricer.setConvergenceMode(convergenceMode);
+        serialPricer.setLatticeModel(latticeModel);
+        std::vector<double> chunkPrices;
+        for (int first = nextOption.fetch_add(chunkSize); first < numOptions;
+             first = nextOption.fetch_add(chunkSize)) {
+            int last = std::min(first + chunkSize, numOptions);
+            serialPricer.priceLattice(optionBatch.slice(first, last),
+                                      chunkPrices);
+            std::copy(chunkPrices.begin(), chunkPrices.end(),
+                      prices.begin() + first);
+        }
+    };
+
+    int numChunks = (numOptions + chunkSize - 1) / chunkSize;
+    int numWorkers = std::min(numThreads, numChunks);
+    std::vector<std::thread> threads;
+    for (int i = 1; i < numWorkers; i++) {
+        threads.push_back(std::thread(worker));
+    }
+    worker();
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+}
@@ -2,35 +2,397 @@
 #define __PRICER_H__
 // System Libraries
 #include <vector>
+#include <string>
+#include <future>
+#include <atomic>
+#include <map>
+#include <memory>
 
+#include "option_spec.h"
+#include "option_batch.h"
+#include "lattice_cache.h"
+
+// CPU-only builds leave out the OpenCL backend and its dependencies
+#ifndef PRICER_CPU_ONLY
 // OpenCL C++ Binding
 #include "cl.hpp"
 
-#include "option_spec.h"
+#include "buffer_pool.h"
+#endif
 
 class OptionPricer {
 public:
     virtual ~OptionPricer() {}
     virtual double price(OptionSpec& optionSpec) = 0;
+    // Prices every option in optionBatch, writing results to prices in order
+    virtual void price(const OptionBatch& optionBatch,
+                       std::vector<double>& prices) = 0;
+    // Converts optionSpecs to an OptionBatch and prices that
+    virtual void price(const std::vector<OptionSpec>& optionSpecs,
+                       std::vector<double>& prices);
+    // Prices optionSpec at every strike of strikePrices, all on the tree of
+    // optionSpec, by default as a batch
+    virtual void priceLadder(const OptionSpec& optionSpec,
+                             const std::vector<float>& strikePrices,
+                             std::vector<double>& prices);
+    // Price with delta, gamma and theta, by default by pricing the option
+    // again with the stock price and the maturity bumped
+    virtual OptionGreeks priceWithGreeks(const OptionSpec& optionSpec);
+    // Volatilities at which the options of optionBatch are worth
+    // marketPrices, NaN where none is, ignoring the volatility column. Every
+    // iteration prices the unconverged options at once, by default as a
+    // batch through price()
+    virtual void impliedVolatility(const OptionBatch& optionBatch,
+                                   const std::vector<double>& marketPrices,
+                                   std::vector<double>& volatilities);
+    // Start pricing and return right away, by default running price() on a
+    // thread of its own
+    virtual std::future<double> priceAsync(const OptionSpec& optionSpec);
+    virtual std::future<std::vector<double> > priceAsync(
+            const std::vector<OptionSpec>& optionSpecs);
+};
+
+// Convergence acceleration of the lattice pricers
+enum ConvergenceMode {
+    // Plain CRR lattice of numSteps time-steps
+    CONVERGENCE_PLAIN,
+    // Binomial Black-Scholes, the last time-step priced in closed form
+    CONVERGENCE_BBS,
+    // BBS with Richardson extrapolation over numSteps and numSteps / 2
+    CONVERGENCE_BBSR
 };
 
+/**
+ * Prices on lattices of the tree model and in the convergence mode set, by
+ * pricing the lattices of the mode with priceLattice
+ *
+ * BBS prices a lattice one time-step shorter, whose values at the last
+ * time-step are Black-Scholes values one time-step before expiry, American
+ * options allowing exercise there. Lattices of fewer than 2 time-steps are
+ * priced on 2. BBSR extrapolates 2 * BBS(numSteps) - BBS(numSteps / 2),
+ * falling back to BBS below 4 time-steps.
+ *
+ * Leisen-Reimer lattices have an odd number of time-steps, numSteps being
+ * rounded up, and are not shortened by BBS. BBSR extrapolates them for
+ * errors falling as 1/N^2.
+ */
 class LatticePricer: public OptionPricer {
+public:
+    LatticePricer();
+    void setConvergenceMode(ConvergenceMode mode);
+    // Tree parameterization of every lattice, LATTICE_CRR by default
+    void setLatticeModel(LatticeModel model);
+    using OptionPricer::price;
+    virtual double price(OptionSpec& optionSpec);
+    // Prices the lattices of every option in a single batch
+    virtual void price(const OptionBatch& optionBatch,
+                       std::vector<double>& prices);
+protected:
+    // Price on a lattice of exactly optionSpec, whose last time-step holds
+    // Black-Scholes values when isSmoothed()
+    virtual double priceLattice(OptionSpec& optionSpec) = 0;
+    virtual void priceLattice(const OptionBatch& optionBatch,
+                              std::vector<double>& prices) = 0;
+    // Lattice priceLattice prices for optionSpec, without the dividends
+    // paid after maturity, and one time-step shorter with the same
+    // time-step under BBS. Leisen-Reimer lattices are rounded up to an odd
+    // number of time-steps
+    OptionSpec latticeSpec(const OptionSpec& optionSpec) const;
+    // BBS and BBSR lattices, except under Leisen-Reimer
+    bool isSmoothed() const;
+    double extrapolate(double finePrice, int fineSteps, double coarsePrice,
+                       int coarseSteps) const;
+
+    ConvergenceMode convergenceMode;
+    LatticeModel latticeModel;
 };
 
 class SerialPricer: public LatticePricer {
 public:
+    // Lattices are cached in latticeCache when given, which may be shared
+    // with other pricers, and in a cache of its own otherwise
+    SerialPricer(LatticeCache* latticeCache = NULL);
+    virtual ~SerialPricer();
+    // Greeks of the same lattice walk, from the nodes near the root, on at
+    // least 2 time-steps, without extrapolation under BBSR
+    virtual OptionGreeks priceWithGreeks(const OptionSpec& optionSpec);
+protected:
+    virtual double priceLattice(OptionSpec& optionSpec);
+    virtual void priceLattice(const OptionBatch& optionBatch,
+                              std::vector<double>& prices);
+private:
+    // Batches of a ParallelPricer are priced by serial workers
+    friend class ParallelPricer;
+
+    // Also differentiates the nodes near the root into greeks when given
+    double priceImpl(const OptionSpec& optionSpec,
+                     std::vector<double>& valueAtExpiry,
+                     std::vector<double>& nodePrice,
+                     OptionGreeks* greeks = NULL);
+
+    LatticeCache* latticeCache;
+    bool ownsLatticeCache;
+};
+
+// Prices on all CPU cores, tiling the lattice like the OpenCL triangle kernels
+// Trinomial lattices are priced on a single core
+class ParallelPricer: public LatticePricer {
+public:
+    // numThreads <= 0 uses every hardware thread
+    ParallelPricer(int numThreads = 0, int stepSize = 256);
+    virtual ~ParallelPricer();
+    // Greeks of the nodes near the root, walked by a single SerialPricer
+    // since the tiles do not keep them
+    virtual OptionGreeks priceWithGreeks(const OptionSpec& optionSpec);
+protected:
+    virtual double priceLattice(OptionSpec& optionSpec);
+    virtual void priceLattice(const OptionBatch& optionBatch,
+                              std::vector<double>& prices);
+private:
+    int numThreads;
+    int stepSize;
+    // Shared by the single option path and the workers of batches
+    LatticeCache* latticeCache;
+};
+
+// Prices every option as European with the Black-Scholes formula, in
+// nanoseconds instead of the milliseconds of a lattice
+class BlackScholesPricer: public OptionPricer {
+public:
+    using OptionPricer::price;
+    virtual double price(OptionSpec& optionSpec);
+    virtual void price(const OptionBatch& optionBatch,
+                       std::vector<double>& prices);
+    // Closed form greeks
+    virtual OptionGreeks priceWithGreeks(const OptionSpec& optionSpec);
+};
+
+/**
+ * Sends European options to a BlackScholesPricer and American ones to a
+ * lattice pricer, splitting batches between the two
+ *
+ * In validation mode European options are priced by both, at numSteps on
+ * the lattice, and prices differing by more than the tolerance are
+ * reported. The Black-Scholes price is returned either way.
+ */
+class RoutingPricer: public OptionPricer {
+public:
+    // Takes ownership of latticePricer
+    RoutingPricer(OptionPricer* latticePricer);
+    virtual ~RoutingPricer();
+    // numSteps <= 0 turns validation off
+    void setValidation(int numSteps, double tolerance);
+    // Largest difference seen in validation mode
+    double maxValidationError() const;
+    using OptionPricer::price;
     virtual double price(OptionSpec& optionSpec);
+    virtual void price(const OptionBatch& optionBatch,
+                       std::vector<double>& prices);
+    virtual OptionGreeks priceWithGreeks(const OptionSpec& optionSpec);
+private:
+    // Prices European options of optionBatch on the lattice and compares
+    // them with their Black-Scholes prices
+    void validate(const OptionBatch& optionBatch,
+                  const std::vector<double>& prices);
+
+    BlackScholesPricer blackScholesPricer;
+    OptionPricer* latticePricer;
+    int validationNumSteps;
+    double validationTolerance;
+    double validationError;
+};
+
+// Arithmetic precision of the OpenCL kernels
+enum Precision {
+    PRECISION_SINGLE,
+    PRECISION_DOUBLE
+};
+
+// Chooses the device of an OpenCLPricer, empty fields match any device
+struct DeviceSelector {
+    // Substrings of CL_PLATFORM_NAME and CL_DEVICE_NAME
+    std::string platformName;
+    std::string deviceName;
+    // "cpu", "gpu", "accelerator" or "all"
+    std::string deviceType;
+    // Index among the matching devices, negative prefers the first GPU
+    int deviceIndex;
+
+    DeviceSelector(): deviceIndex(-1) {}
+};
+
+// Lattice algorithm of OpenCLPricer for options too large for one work group
+enum LatticeAlgorithm {
+    // One launch per time-step
+    ALGORITHM_GROUP,
+    // Up and down triangles of stepSize time-steps in local memory
+    ALGORITHM_TRIANGLE,
+    // Tiles with halos advancing stepSize time-steps per launch
+    ALGORITHM_TRAPEZOID
 };
 
-//TODO(disiok): Implement American opions
+#ifndef PRICER_CPU_ONLY
+class TuningTable;
+
+// Host state of a pricing call in flight on a command queue
+template <typename Real>
+struct PricingJob;
+
 class OpenCLPricer: public LatticePricer {
 public:
-    OpenCLPricer();
+    // PRECISION_DOUBLE falls back to single on devices without cl_khr_fp64
+    OpenCLPricer(Precision precision = PRECISION_SINGLE);
+    OpenCLPricer(const DeviceSelector& selector,
+                 Precision precision = PRECISION_SINGLE);
     virtual ~OpenCLPricer();
-    virtual double price(OptionSpec& optionSpec);
+    // False when no usable device was found or the kernels failed to build,
+    // in which case the pricer must not be used
+    bool isAvailable() const;
+    // Fixes the algorithm used by price() instead of the tuning table,
+    // stepSize is the lattice points per work-item of ALGORITHM_GROUP and the
+    // time-steps per launch of the others
+    void setAlgorithm(LatticeAlgorithm algorithm, int stepSize);
+    // Times every algorithm and step size the device allows on a lattice of
+    // the numSteps bucket, recording the fastest in the tuning table
+    void tune(int numSteps);
+    // Carries the option values of every strike through one sweep of the
+    // lattice, sharing node prices and weights between strikes, as a batch
+    // in BBS and BBSR modes and on Leisen-Reimer and trinomial lattices
+    virtual void priceLadder(const OptionSpec& optionSpec,
+                             const std::vector<float>& strikePrices,
+                             std::vector<double>& prices);
+    // Greeks of the same lattice walk, from the nodes near the root that the
+    // last up triangle keeps in a side buffer, on at least 2 time-steps,
+    // without extrapolation under BBSR, and by bumping on trinomial lattices
+    virtual OptionGreeks priceWithGreeks(const OptionSpec& optionSpec);
+    // Iterates every option on the device in a single kernel execution,
+    // iterating through price() batches in BBS and BBSR modes
+    virtual void impliedVolatility(const OptionBatch& optionBatch,
+                                   const std::vector<double>& marketPrices,
+                                   std::vector<double>& volatilities);
+    // Enqueue the pricing and complete the future from an event callback,
+    // pipelining calls across several command queues. Like price(), these
+    // must not be called concurrently from several threads. BBSR calls
+    // price synchronously and return a ready future
+    virtual std::future<double> priceAsync(const OptionSpec& optionSpec);
+    virtual std::future<std::vector<double> > priceAsync(
+            const std::vector<OptionSpec>& optionSpecs);
+protected:
+    virtual double priceLattice(OptionSpec& optionSpec);
+    virtual void priceLattice(const OptionBatch& optionBatch,
+                              std::vector<double>& prices);
 private:
+    // Real is the host type matching the real typedef of the built kernels
+    template <typename Real>
+    double priceImplOption(const OptionSpec& optionSpec);
+    template <typename Real>
+    void priceImplBatch(const OptionBatch& optionBatch,
+                        std::vector<double>& prices);
+    template <typename Real>
     double priceImplGroup(OptionSpec& optionSpec, int groupSize);
+    template <typename Real>
     double priceImplTriangle(OptionSpec& optionSpec, int stepSize);
+    template <typename Real>
+    double priceImplTrapezoid(OptionSpec& optionSpec, int stepsPerLaunch);
+    template <typename Real>
+    void priceImplLadder(const OptionSpec& optionSpec,
+                         const std::vector<float>& strikePrices,
+                         std::vector<double>& prices);
+    template <typename Real>
+    OptionGreeks priceImplGreeks(const OptionSpec& optionSpec);
+    template <typename Real>
+    void impliedVolatilityImpl(const OptionBatch& optionBatch,
+                               const std::vector<double>& marketPrices,
+                               std::vector<double>& volatilities);
+    template <typename Real>
+    void tuneImpl(int numSteps);
+    template <typename Real>
+    std::future<double> priceAsyncImpl(const OptionSpec& optionSpec);
+    template <typename Real>
+    std::future<std::vector<double> > priceAsyncImpl(
+            const std::vector<OptionSpec>& optionSpecs);
+
+    // Lattice of a tree with its node price tables resident on the device
+    struct DeviceLattice {
+        std::shared_ptr<const Lattice> lattice;
+        cl::Buffer upPowers;
+        cl::Buffer downPowers;
+        // Value of numLatticeUses when last used, for eviction
+        unsigned long lastUse;
+    };
+
+    // Device lattice of optionSpec, derived and uploaded through queue on a
+    // miss and reused by every strike and type on the same tree
+    template <typename Real>
+    DeviceLattice deviceLattice(cl::CommandQueue* queue,
+                                const OptionSpec& optionSpec);
+
+    // Algorithm and stepSize price() uses for a lattice of numSteps
+    void chooseAlgorithm(int numSteps, LatticeAlgorithm* algorithm,
+                         int* stepSize) const;
+    // Largest stepSize whose triangle fits a work group and local memory
+    int maxTriangleStepSize() const;
+
+    // Enqueue the device work of a pricing call without waiting for it,
+    // returning the buffer the results will be read from
+    template <typename Real>
+    cl::Buffer enqueueOption(cl::CommandQueue* queue,
+                             const OptionSpec& optionSpec,
+                             PricingJob<Real>* job);
+    // Columns of optionBatch are uploaded without blocking, so the batch
+    // has to outlive the job
+    template <typename Real>
+    cl::Buffer enqueueBatch(cl::CommandQueue* queue,
+                            const OptionBatch& optionBatch,
+                            PricingJob<Real>* job);
+    template <typename Real>
+    cl::Buffer enqueueGroup(cl::CommandQueue* queue,
+                            const OptionSpec& optionSpec, int groupSize,
+                            PricingJob<Real>* job);
+    // Option values of the nodes near the root are left in nearRootBuffer
+    // when given
+    template <typename Real>
+    cl::Buffer enqueueTriangle(cl::CommandQueue* queue,
+                               const OptionSpec& optionSpec, int stepSize,
+                               PricingJob<Real>* job,
+                               cl::Buffer* nearRootBuffer = NULL);
+    template <typename Real>
+    cl::Buffer enqueueTrapezoid(cl::CommandQueue* queue,
+                                const OptionSpec& optionSpec,
+                                int stepsPerLaunch, PricingJob<Real>* job);
+    template <typename Real>
+    cl::Buffer enqueueLadder(cl::CommandQueue* queue,
+                             const OptionSpec& optionSpec,
+                             const float* strikePrices, int numStrikes,
+                             PricingJob<Real>* job);
+    template <typename Real>
+    cl::Buffer enqueueTrapezoidSteps(cl::CommandQueue* queue,
+                                     const OptionSpec& optionSpec,
+                                     Real stockPrice,
+                                     Real upWeight, Real downWeight,
+                                     Real discountFactor,
+                                     const cl::Buffer& upPowers,
+                                     const cl::Buffer& downPowers,
+                                     const cl::Buffer& dividendEscrows,
+                                     const cl::Buffer& valueBuffer,
+                                     const cl::Buffer& tempBuffer,
+                                     int latticeStep, int numTimeSteps,
+                                     int stepsPerLaunch);
+
+    Precision precision;
+    bool available;
+    // Set by setAlgorithm, otherwise price() follows the tuning table
+    bool isAlgorithmFixed;
+    LatticeAlgorithm algorithm;
+    int algorithmStepSize;
+    // Tuning results of every device, keyed by deviceKey for this one
+    TuningTable* tuningTable;
+    std::string deviceKey;
+    // Tune numSteps buckets missing from the table on first use
+    bool isAutoTuning;
+    // Least recently used lattices stay resident on the device
+    std::map<LatticeKey, DeviceLattice> deviceLattices;
+    unsigned long numLatticeUses;
 
     std::vector<cl::Platform>* platforms;
     cl::Platform* defaultPlatform;
@@ -38,7 +400,27 @@ private:
     cl::Device* defaultDevice;
     cl::Context* context;
     std::string* kernelCode;
-    cl::Program::Sources* sources;
     cl::Program* program;
+
+    // Created once and reused by every pricing call
+    cl::CommandQueue* queue;
+    // Asynchronous calls are spread round robin over their own queues
+    std::vector<cl::CommandQueue*> asyncQueues;
+    size_t nextAsyncQueue;
+    // Asynchronous calls whose completion callback has not run yet
+    std::atomic<int> numPendingJobs;
+    cl::Kernel* initKernel;
+    cl::Kernel* groupKernel;
+    cl::Kernel* trapezoidKernel;
+    cl::Kernel* ladderInitKernel;
+    cl::Kernel* ladderKernel;
+    cl::Kernel* upKernel;
+    cl::Kernel* downKernel;
+    cl::Kernel* batchKernel;
+    cl::Kernel* batchLocalKernel;
+    cl::Kernel* batchItemKernel;
+    cl::Kernel* impliedVolatilityKernel;
+    BufferPool* bufferPool;
 };
 #endif
+#endif
@@ -0,0 +1,92 @@
+// System Libraries
+#include <string>
+#include <iostream>
+#include <cstdlib>
+
+#include "pricer.h"
+#include "pricer_factory.h"
+
+// Value of an environment variable, or fallback when it is unset
+static std::string environment(const char* name, const std::string& fallback) {
+    const char* value = getenv(name);
+    return value != NULL ? value : fallback;
+}
+
+// Lattice model of name, or LATTICE_CRR when the name is unknown
+static LatticeModel latticeModel(const std::string& name) {
+    const char* names[] = {"crr", "jr", "tian", "lr", "trinomial"};
+    for (int i = 0; i < 5; i ++) {
+        if (name == names[i]) {
+            return (LatticeModel) i;
+        }
+    }
+    std::cerr   << "[ERROR] Unknown lattice model: " << name << std::endl;
+    return LATTICE_CRR;
+}
+
+PricerConfig pricerConfigFromEnvironment() {
+    PricerConfig config;
+    config.backend = environment("PRICER_BACKEND", config.backend);
+    config.device.platformName = environment("PRICER_PLATFORM", "");
+    config.device.deviceName = environment("PRICER_DEVICE", "");
+    config.device.deviceType = environment("PRICER_DEVICE_TYPE", "");
+    config.device.deviceIndex = atoi(
+            environment("PRICER_DEVICE_INDEX", "-1").c_str());
+    if (environment("PRICER_PRECISION", "single") == "double") {
+        config.precision = PRECISION_DOUBLE;
+    }
+    config.numThreads = atoi(environment("PRICER_THREADS", "0").c_str());
+    config.latticeModel = latticeModel(
+            environment("PRICER_LATTICE_MODEL", "crr"));
+    config.routeEuropean = environment("PRICER_ROUTE_EUROPEAN", "0") == "1";
+    config.validationNumSteps = atoi(
+            environment("PRICER_VALIDATE_STEPS", "0").c_str());
+    return config;
+}
+
+// Tolerance of the validation of routed European prices
+static const double VALIDATION_TOLERANCE = 1e-2;
+
+static LatticePricer* createLatticePricer(const PricerConfig& config) {
+    if (config.backend == "serial") {
+        return new SerialPricer();
+    } else if (config.backend == "parallel") {
+        return new ParallelPricer(config.numThreads);
+    } else if (config.backend != "auto" && config.backend != "opencl") {
+        std::cerr   << "[ERROR] Unknown pricer backend: " << config.backend
+                    << std::endl;
+        return NULL;
+    }
+
+#ifndef PRICER_CPU_ONLY
+    OpenCLPricer* openclPricer = new OpenCLPricer(config.device,
+                                                  config.precision);
+    if (openclPricer->isAvailable()) {
+        return openclPricer;
+    }
+    delete openclPricer;
+    std::cout   << "[INFO] OpenCL unavailable, falling back to parallel pricer"
+                << std::endl;
+#else
+    std::cout   << "[INFO] Built without OpenCL, using parallel pricer"
+                << std::endl;
+#endif
+    return new ParallelPricer(config.numThreads);
+}
+
+OptionPricer* createPricer(const PricerConfig& config) {
+    if (config.backend == "blackscholes") {
+        return new BlackScholesPricer();
+    }
+    LatticePricer* latticePricer = createLatticePricer(config);
+    if (latticePricer != NULL) {
+        latticePricer->setLatticeModel(config.latticeModel);
+    }
+    if (latticePricer == NULL || !config.routeEuropean) {
+        return latticePricer;
+    }
+    RoutingPricer* routingPricer = new RoutingPricer(latticePricer);
+    routingPricer->setValidation(config.validationNumSteps,
+                                 VALIDATION_TOLERANCE);
+    return routingPricer;
+}
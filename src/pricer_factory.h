@@ -0,0 +1,50 @@
+#ifndef __PRICER_FACTORY_H__
+#define __PRICER_FACTORY_H__
+// System Libraries
+#include <string>
+
+#include "pricer.h"
+
+// Backend and device choice of createPricer
+struct PricerConfig {
+    // "auto", "opencl", "parallel", "serial" or "blackscholes"
+    std::string backend;
+    DeviceSelector device;
+    Precision precision;
+    // Threads of the parallel pricer, <= 0 uses every hardware thread
+    int numThreads;
+    // Tree parameterization of the lattice pricers
+    LatticeModel latticeModel;
+    // Price European options with Black-Scholes through a RoutingPricer
+    bool routeEuropean;
+    // Validate the routed European prices on lattices of this many steps
+    // when positive
+    int validationNumSteps;
+
+    PricerConfig(): backend("auto"), precision(PRECISION_SINGLE),
+                    numThreads(0), latticeModel(LATTICE_CRR),
+                    routeEuropean(false),
+                    validationNumSteps(0) {}
+};
+
+/**
+ * Reads a PricerConfig from the environment, leaving defaults for unset
+ * variables:
+ *  PRICER_BACKEND, PRICER_PLATFORM, PRICER_DEVICE, PRICER_DEVICE_TYPE,
+ *  PRICER_DEVICE_INDEX, PRICER_PRECISION ("single" or "double"),
+ *  PRICER_THREADS, PRICER_LATTICE_MODEL ("crr", "jr", "tian", "lr" or
+ *  "trinomial"), PRICER_ROUTE_EUROPEAN ("1" to route) and
+ *  PRICER_VALIDATE_STEPS
+ */
+PricerConfig pricerConfigFromEnvironment();
+
+/**
+ * Creates the pricer of the configured backend
+ *
+ * "auto" and "opencl" probe for a usable OpenCL device and fall back to a
+ * ParallelPricer when there is none, so the caller always gets a pricer.
+ * With routeEuropean the lattice pricer is wrapped in a RoutingPricer.
+ * Returns NULL only for an unknown backend name.
+ */
+OptionPricer* createPricer(const PricerConfig& config = PricerConfig());
+#endif
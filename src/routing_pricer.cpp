@@ -0,0 +1,106 @@
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+
+#include "option_spec.h"
+#include "option_batch.h"
+#include "pricer.h"
+
+RoutingPricer::RoutingPricer(OptionPricer* latticePricer):
+    latticePricer(latticePricer), validationNumSteps(0),
+    validationTolerance(0), validationError(0) {
+}
+
+RoutingPricer::~RoutingPricer() {
+    delete latticePricer;
+}
+
+void RoutingPricer::setValidation(int numSteps, double tolerance) {
+    validationNumSteps = numSteps;
+    validationTolerance = tolerance;
+}
+
+double RoutingPricer::maxValidationError() const {
+    return validationError;
+}
+
+double RoutingPricer::price(OptionSpec& optionSpec) {
+    if (optionSpec.isAmerican) {
+        return latticePricer->price(optionSpec);
+    }
+    std::vector<double> prices(1, blackScholesPricer.price(optionSpec));
+    if (validationNumSteps > 0) {
+        OptionBatch optionBatch;
+        optionBatch.push_back(optionSpec);
+        validate(optionBatch, prices);
+    }
+    return prices[0];
+}
+
+/**
+ * European and American options are gathered into a batch each, priced by
+ * their pricer and scattered back into the order of optionBatch
+ */
+void RoutingPricer::price(const OptionBatch& optionBatch,
+                          std::vector<double>& prices) {
+    OptionBatch europeanBatch;
+    OptionBatch americanBatch;
+    std::vector<size_t> europeanIndices;
+    std::vector<size_t> americanIndices;
+    for (size_t i = 0; i < optionBatch.size(); i ++) {
+        if (optionBatch.isAmerican[i]) {
+            americanBatch.push_back(optionBatch[i]);
+            americanIndices.push_back(i);
+        } else {
+            europeanBatch.push_back(optionBatch[i]);
+            europeanIndices.push_back(i);
+        }
+    }
+
+    std::vector<double> europeanPrices;
+    std::vector<double> americanPrices;
+    blackScholesPricer.price(europeanBatch, europeanPrices);
+    if (americanBatch.size() > 0) {
+        latticePricer->price(americanBatch, americanPrices);
+    }
+
+    prices.resize(optionBatch.size());
+    for (size_t i = 0; i < europeanIndices.size(); i ++) {
+        prices[europeanIndices[i]] = europeanPrices[i];
+    }
+    for (size_t i = 0; i < americanIndices.size(); i ++) {
+        prices[americanIndices[i]] = americanPrices[i];
+    }
+
+    if (validationNumSteps > 0 && europeanBatch.size() > 0) {
+        validate(europeanBatch, europeanPrices);
+    }
+}
+
+OptionGreeks RoutingPricer::priceWithGreeks(const OptionSpec& optionSpec) {
+    if (optionSpec.isAmerican) {
+        return latticePricer->priceWithGreeks(optionSpec);
+    }
+    return blackScholesPricer.priceWithGreeks(optionSpec);
+}
+
+void RoutingPricer::validate(const OptionBatch& optionBatch,
+                             const std::vector<double>& prices) {
+    OptionBatch latticeBatch(optionBatch);
+    std::fill(latticeBatch.numSteps.begin(), latticeBatch.numSteps.end(),
+              validationNumSteps);
+    std::vector<double> latticePrices;
+    latticePricer->price(latticeBatch, latticePrices);
+
+    for (size_t i = 0; i < optionBatch.size(); i ++) {
+        double error = std::abs(latticePrices[i] - prices[i]);
+        validationError = std::max(validationError, error);
+        if (error > validationTolerance) {
+            std::cerr   << "[ERROR] Black-Scholes price " << prices[i]
+                        << " differs from the lattice price "
+                        << latticePrices[i] << " of" << std::endl
+                        << latticeBatch[i];
+        }
+    }
+}
@@ -2,49 +2,171 @@
 #include <cmath>
 #include <algorithm>
 #include <iostream>
+#include <memory>
 
 #include "option_spec.h"
+#include "option_batch.h"
 #include "pricer.h"
+#include "lattice_kernels.h"
+#include "lattice_cache.h"
+#include "black_scholes.h"
 
-double SerialPricer::price(OptionSpec& optionSpec){
-    // ------------------------Derived Parameters------------------------------
-    double deltaT = optionSpec.yearsToMaturity / optionSpec.numSteps;
+SerialPricer::SerialPricer(LatticeCache* latticeCache):
+    latticeCache(latticeCache), ownsLatticeCache(latticeCache == NULL) {
+    if (ownsLatticeCache) {
+        this->latticeCache = new LatticeCache();
+    }
+}
 
-    double upFactor = exp(optionSpec.volatility * sqrt(deltaT));
-    double downFactor = 1.0 / upFactor;
+SerialPricer::~SerialPricer() {
+    if (ownsLatticeCache) {
+        delete latticeCache;
+    }
+}
 
-    double discountFactor = exp(optionSpec.riskFreeRate * deltaT);
+double SerialPricer::priceLattice(OptionSpec& optionSpec){
+    std::vector<double> valueAtExpiry(optionSpec.numSteps + 1);
+    std::vector<double> nodePrice(optionSpec.numSteps + 1);
+    return priceImpl(optionSpec, valueAtExpiry, nodePrice);
+}
 
-    double upWeight = (discountFactor - downFactor) / (upFactor - downFactor);
-    double downWeight = 1.0 - upWeight;
+OptionGreeks SerialPricer::priceWithGreeks(const OptionSpec& optionSpec) {
+    // Gamma and theta need the nodes of time-step 2, BBS takes one away
+    OptionSpec spec = optionSpec;
+    spec.numSteps = std::max(spec.numSteps, isSmoothed() ? 3 : 2);
+    spec = latticeSpec(spec);
+    std::vector<double> valueAtExpiry(spec.numSteps + 1);
+    std::vector<double> nodePrice(spec.numSteps + 1);
+    OptionGreeks greeks;
+    priceImpl(spec, valueAtExpiry, nodePrice, &greeks);
+    return greeks;
+}
+
+// Keeps the option values of a time-step near the root
+static void keepNearRoot(double* nearRootValues, const double* optionValue,
+                         int step, const Lattice& lattice) {
+    if (lattice.numBranches == 3) {
+        if (step <= 1) {
+            std::copy(optionValue, optionValue + lattice.numNodes(step),
+                      nearRootValues + step);
+        }
+    } else if (step <= 2) {
+        std::copy(optionValue, optionValue + step + 1,
+                  nearRootValues + step * (step + 1) / 2);
+    }
+}
+
+/**
+ * Prices the whole batch through a single lattice buffer that is grown to the
+ * largest numSteps once, instead of allocating a fresh one for every option.
+ */
+void SerialPricer::priceLattice(const OptionBatch& optionBatch,
+                                std::vector<double>& prices) {
+    int maxNumSteps = 0;
+    for (size_t i = 0; i < optionBatch.size(); ++i) {
+        maxNumSteps = std::max(maxNumSteps, optionBatch.numSteps[i]);
+    }
+
+    std::vector<double> valueAtExpiry(maxNumSteps + 1);
+    std::vector<double> nodePrice(maxNumSteps + 1);
+    prices.resize(optionBatch.size());
+    for (size_t i = 0; i < optionBatch.size(); ++i) {
+        prices[i] = priceImpl(optionBatch[i], valueAtExpiry, nodePrice);
+    }
+}
+
+double SerialPricer::priceImpl(const OptionSpec& optionSpec,
+                               std::vector<double>& valueAtExpiry,
+                               std::vector<double>& nodePrice,
+                               OptionGreeks* greeks) {
+    // ------------------------Derived Parameters------------------------------
+    // Shared by every option on the same tree, only the payoff is per option
+    std::shared_ptr<const Lattice> lattice = latticeCache->get(optionSpec,
+                                                               latticeModel);
+    double upFactor = lattice->upFactor;
+    double downFactor = lattice->downFactor;
+    double discountFactor = lattice->discountFactor;
+    double upWeight = lattice->upWeight;
+    double middleWeight = lattice->middleWeight;
+    double downWeight = lattice->downWeight;
+    bool isTrinomial = lattice->numBranches == 3;
+
+    // Trinomial lattices have 2 * numSteps + 1 nodes at expiry
+    size_t numTerminalNodes = lattice->terminalPrices.size();
+    if (valueAtExpiry.size() < numTerminalNodes) {
+        valueAtExpiry.resize(numTerminalNodes);
+        nodePrice.resize(numTerminalNodes);
+    }
 
     // -----------------Calculate option value at expiry-----------------------
-    std::vector<double> valueAtExpiry(optionSpec.numSteps + 1);
-    for (int i = 0; i <= optionSpec.numSteps; ++i) {
-        double stockPriceAtExpiry = optionSpec.stockPrice * 
-                                   pow(upFactor, i) *
-                                   pow(downFactor, optionSpec.numSteps - i);
-        valueAtExpiry[i] = std::max(optionSpec.type * 
-                                (stockPriceAtExpiry - optionSpec.strikePrice),
-                                0.0);
+    const std::vector<double>& terminalPrices = lattice->terminalPrices;
+    double expiryStrike = lattice->exerciseStrike(optionSpec,
+                                                  optionSpec.numSteps);
+    for (size_t i = 0; i < numTerminalNodes; ++i) {
+        // Last time-step of a BBS lattice is one time-step before expiry
+        if (isSmoothed()) {
+            valueAtExpiry[i] = blackScholesNodeValue(optionSpec,
+                                                     terminalPrices[i],
+                                                     lattice->deltaT,
+                                                     expiryStrike);
+        } else {
+            valueAtExpiry[i] = std::max(optionSpec.type *
+                                    (terminalPrices[i] - optionSpec.strikePrice),
+                                    0.0);
+        }
         // std::cout << "[TRACE] valueAtExpiry[" << i << "] = " << valueAtExpiry[i] << std::endl;
     }
+    double nearRootValues[NUM_NEAR_ROOT_VALUES];
+    if (greeks != NULL) {
+        keepNearRoot(nearRootValues, &valueAtExpiry[0], optionSpec.numSteps,
+                     *lattice);
+    }
+    // Node prices of American options are carried back from expiry
+    if (optionSpec.isAmerican) {
+        std::copy(terminalPrices.begin(), terminalPrices.end(),
+                  nodePrice.begin());
+    }
     
     // -----------Iterate backwards to obtain initial option value-------------
+    // Fold the discounting into the weights to avoid a division per node
+    double discountedUpWeight = upWeight / discountFactor;
+    double discountedMiddleWeight = middleWeight / discountFactor;
+    double discountedDownWeight = downWeight / discountFactor;
+    // Nodes keep their index from one time-step to the previous, which
+    // divides their prices by downFactor once per branch beyond the first
+    double previousFactor = isTrinomial ? downFactor * downFactor
+                                        : downFactor;
     for (int i = optionSpec.numSteps - 1; i >= 0; --i) {
-        for (int j = 0; j <= i; j++) {
-            valueAtExpiry[j] = (downWeight * valueAtExpiry[j] +
-                                upWeight * valueAtExpiry[j + 1]) 
-                                / discountFactor; 
-            // Calculate payoff if exercised for American options
-            if (optionSpec.isAmerican) {
-                double stockPrice = optionSpec.stockPrice *
-                                    pow(upFactor, j) *
-                                    pow(downFactor, i - j);
-                valueAtExpiry[j] = std::max(valueAtExpiry[j], std::max(0.0, 
-                    optionSpec.type * (stockPrice - optionSpec.strikePrice)));
+        int numNodes = lattice->numNodes(i);
+        if (isTrinomial) {
+            trinomialInduction(&valueAtExpiry[0], numNodes,
+                               discountedUpWeight, discountedMiddleWeight,
+                               discountedDownWeight);
+        } else {
+            backwardInduction(&valueAtExpiry[0], numNodes,
+                              discountedUpWeight, discountedDownWeight);
+        }
+
+        // Calculate payoff if exercised for American options, node prices
+        // are carried over from the previous time-step and only
+        // recomputed every NODE_PRICE_ANCHOR time-steps
+        if (optionSpec.isAmerican) {
+            if ((optionSpec.numSteps - i) % NODE_PRICE_ANCHOR == 0) {
+                nodePrices(&nodePrice[0], lattice->stockPrice, upFactor,
+                           downFactor, numNodes - 1, 0, numNodes);
+            } else {
+                previousNodePrices(&nodePrice[0], numNodes, previousFactor);
             }
+            exerciseValue(&valueAtExpiry[0], &nodePrice[0], numNodes,
+                          optionSpec.type,
+                          lattice->exerciseStrike(optionSpec, i));
         }    
+        if (greeks != NULL) {
+            keepNearRoot(nearRootValues, &valueAtExpiry[0], i, *lattice);
+        }
+    }
+    if (greeks != NULL) {
+        *greeks = lattice->greeks(nearRootValues);
     }
     return valueAtExpiry[0];
 }
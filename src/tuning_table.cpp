@@ -0,0 +1,102 @@
+// System Libraries
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "pricer.h"
+#include "tuning_table.h"
+
+static const char* ALGORITHM_NAMES[] = {"group", "triangle", "trapezoid"};
+static const int NUM_ALGORITHMS = 3;
+
+TuningTable::TuningTable(const std::string& path): path(path) {
+    load();
+}
+
+bool TuningTable::lookup(const std::string& deviceKey, int numSteps,
+                         TuningEntry* entry) const {
+    std::map<std::pair<std::string, int>, TuningEntry>::const_iterator it =
+        entries.find(std::make_pair(deviceKey, bucket(numSteps)));
+    if (it == entries.end()) {
+        return false;
+    }
+    *entry = it->second;
+    return true;
+}
+
+void TuningTable::record(const std::string& deviceKey, int numSteps,
+                         const TuningEntry& entry) {
+    // Pick up entries other processes recorded since the table was loaded
+    load();
+    entries[std::make_pair(deviceKey, bucket(numSteps))] = entry;
+    save();
+}
+
+int TuningTable::bucket(int numSteps) {
+    int bucket = 1;
+    while (bucket <= numSteps / 2) {
+        bucket *= 2;
+    }
+    return bucket;
+}
+
+/**
+ * Lines hold the device key, bucket, algorithm name, stepSize and time in
+ * milliseconds separated by tabs, malformed lines are skipped
+ */
+void TuningTable::load() {
+    if (path.empty()) {
+        return;
+    }
+    std::ifstream ifs(path.c_str());
+    std::string line;
+    while (std::getline(ifs, line)) {
+        std::istringstream iss(line);
+        std::string deviceKey, bucket, algorithm, stepSize, milliseconds;
+        if (!std::getline(iss, deviceKey, '\t') ||
+            !std::getline(iss, bucket, '\t') ||
+            !std::getline(iss, algorithm, '\t') ||
+            !std::getline(iss, stepSize, '\t') ||
+            !std::getline(iss, milliseconds)) {
+            continue;
+        }
+        for (int i = 0; i < NUM_ALGORITHMS; i ++) {
+            if (algorithm == ALGORITHM_NAMES[i]) {
+                TuningEntry entry = {(LatticeAlgorithm) i,
+                                     atoi(stepSize.c_str()),
+                                     atof(milliseconds.c_str())};
+                entries[std::make_pair(deviceKey, atoi(bucket.c_str()))] =
+                    entry;
+            }
+        }
+    }
+}
+
+void TuningTable::save() {
+    if (path.empty()) {
+        return;
+    }
+
+    // Write to a private file and rename it into place, like KernelCache
+    std::ostringstream tempPath;
+    tempPath << path << ".tmp." << getpid();
+    std::ofstream ofs(tempPath.str().c_str());
+    std::map<std::pair<std::string, int>, TuningEntry>::const_iterator it;
+    for (it = entries.begin(); it != entries.end(); ++it) {
+        ofs << it->first.first << '\t'
+            << it->first.second << '\t'
+            << ALGORITHM_NAMES[it->second.algorithm] << '\t'
+            << it->second.stepSize << '\t'
+            << it->second.milliseconds << '\n';
+    }
+    ofs.close();
+    if (!ofs || rename(tempPath.str().c_str(), path.c_str()) != 0) {
+        std::cerr   << "[ERROR] Could not write tuning table to " << path
+                    << std::endl;
+        remove(tempPath.str().c_str());
+    }
+}
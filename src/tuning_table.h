@@ -0,0 +1,42 @@
+#ifndef __TUNING_TABLE_H__
+#define __TUNING_TABLE_H__
+// System Libraries
+#include <string>
+#include <map>
+#include <utility>
+
+#include "pricer.h"
+
+// Fastest lattice algorithm measured for a device and numSteps bucket
+struct TuningEntry {
+    LatticeAlgorithm algorithm;
+    int stepSize;
+    double milliseconds;
+};
+
+/**
+ * Tuning results persisted as a text file, one entry per line
+ *
+ * Entries are keyed by a device key naming the device, driver and precision,
+ * and by the power of two bucket of numSteps, so that one sweep covers every
+ * lattice of similar size. Processes tuning concurrently merge with the file
+ * on every record, the last writer winning for the same key.
+ */
+class TuningTable {
+public:
+    // An empty path keeps the table in memory only
+    TuningTable(const std::string& path);
+    bool lookup(const std::string& deviceKey, int numSteps,
+                TuningEntry* entry) const;
+    void record(const std::string& deviceKey, int numSteps,
+                const TuningEntry& entry);
+    // Largest power of two not above numSteps
+    static int bucket(int numSteps);
+private:
+    void load();
+    void save();
+
+    std::string path;
+    std::map<std::pair<std::string, int>, TuningEntry> entries;
+};
+#endif
@@ -0,0 +1,861 @@
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include "option_spec.h"
+#include "option_batch.h"
+#include "pricer.h"
+#include "pricer_factory.h"
+#include "black_scholes.h"
+#include "lattice_kernels.h"
+#include "lattice_cache.h"
+#ifndef PRICER_CPU_ONLY
+#include <dirent.h>
+#include <unistd.h>
+#include "tuning_table.h"
+#endif
+
+// Checks run by ctest, each comparing prices against a tolerance and
+// reporting the largest error it saw
+
+static int numFailures = 0;
+
+static void check(const char* name, double error, double tolerance) {
+    if (error <= tolerance) {
+        std::cout   << "[INFO] " << name << ": " << error << std::endl;
+    } else {
+        std::cerr   << "[ERROR] " << name << ": " << error
+                    << " exceeds " << tolerance << std::endl;
+        numFailures ++;
+    }
+}
+
+// Calls and puts, European and American, across strikes and maturities
+static std::vector<OptionSpec> testOptions(int numSteps) {
+    std::vector<OptionSpec> optionSpecs;
+    for (int i = 0; i < 8; i ++) {
+        OptionSpec optionSpec = {i % 2 == 0 ? 1 : -1, 100, 90.0f + 5 * (i / 2),
+                                 0.5f + 0.25f * (i % 3), 0.3f, 0.03f,
+                                 numSteps + i, i % 4 >= 2};
+        optionSpecs.push_back(optionSpec);
+    }
+    return optionSpecs;
+}
+
+// testOptions with a dividend yield on every other option and two cash
+// dividends on half of them, the second after some of their maturities
+static std::vector<OptionSpec> dividendOptions(int numSteps) {
+    std::vector<OptionSpec> optionSpecs = testOptions(numSteps);
+    for (size_t i = 0; i < optionSpecs.size(); i ++) {
+        if (i % 2 == 1) {
+            optionSpecs[i].dividendYield = 0.02f;
+        }
+        if (i % 4 < 2) {
+            optionSpecs[i].addDividend(0.25f, 1.5f);
+            optionSpecs[i].addDividend(0.9f, 2.0f);
+        }
+    }
+    return optionSpecs;
+}
+
+// Largest difference between the prices of a batch and those of its options
+// priced one at a time
+static double batchError(OptionPricer* pricer,
+                         std::vector<OptionSpec>& optionSpecs) {
+    std::vector<double> prices;
+    pricer->price(optionSpecs, prices);
+    double error = 0;
+    for (size_t i = 0; i < optionSpecs.size(); i ++) {
+        error = std::max(error, std::fabs(prices[i] -
+                                          pricer->price(optionSpecs[i])));
+    }
+    return error;
+}
+
+// Options start without dividends and take at most MAX_DIVIDENDS of them
+static void testOptionSpec() {
+    OptionSpec optionSpec;
+    int errors = optionSpec.type != 0 || optionSpec.stockPrice != 0 ||
+                 optionSpec.numSteps != 0 || optionSpec.isAmerican ||
+                 optionSpec.dividendYield != 0 ||
+                 optionSpec.numDividends != 0;
+    OptionSpec europeanSpec(1, 100, 100, 1.0, 0.3, 0.02, 100, false);
+    errors += europeanSpec.dividendYield != 0 ||
+              europeanSpec.numDividends != 0;
+    for (int i = 0; i < MAX_DIVIDENDS; i ++) {
+        errors += !optionSpec.addDividend(0.1f * (i + 1), 1);
+    }
+    std::cout << "[INFO] Adding a dividend beyond MAX_DIVIDENDS" << std::endl;
+    errors += optionSpec.addDividend(0.9f, 1);
+    errors += optionSpec.numDividends != MAX_DIVIDENDS;
+
+    // Specs claiming more dividends only hold MAX_DIVIDENDS of them
+    double escrow = dividendEscrow(optionSpec, 0);
+    std::ostringstream out;
+    out << optionSpec;
+    std::string printed = out.str();
+    optionSpec.numDividends = MAX_DIVIDENDS + 4;
+    errors += dividendEscrow(optionSpec, 0) != escrow;
+    out.str("");
+    out << optionSpec;
+    errors += out.str() != printed;
+    std::cout << "[INFO] Option spec defaults" << std::endl;
+    check("Wrong fields", errors, 0);
+}
+
+// Whether every field of the two options matches
+static bool sameOption(const OptionSpec& a, const OptionSpec& b) {
+    return a.type == b.type && a.stockPrice == b.stockPrice &&
+           a.strikePrice == b.strikePrice &&
+           a.yearsToMaturity == b.yearsToMaturity &&
+           a.volatility == b.volatility && a.riskFreeRate == b.riskFreeRate &&
+           a.numSteps == b.numSteps && a.isAmerican == b.isAmerican &&
+           a.dividendYield == b.dividendYield &&
+           a.numDividends == b.numDividends &&
+           std::equal(a.dividendTimes, a.dividendTimes + a.numDividends,
+                      b.dividendTimes) &&
+           std::equal(a.dividendAmounts, a.dividendAmounts + a.numDividends,
+                      b.dividendAmounts);
+}
+
+// Options gathered back from a batch and its slices are the ones it was
+// built from, and its columns are aligned
+static void testOptionBatch() {
+    std::vector<OptionSpec> optionSpecs = dividendOptions(100);
+    OptionBatch optionBatch(optionSpecs);
+    OptionBatch slice = optionBatch.slice(2, 5);
+    int errors = optionBatch.size() != optionSpecs.size();
+    for (size_t i = 0; i < optionBatch.size(); i ++) {
+        errors += !sameOption(optionBatch[i], optionSpecs[i]);
+    }
+    errors += slice.size() != 3;
+    for (size_t i = 0; i < slice.size(); i ++) {
+        errors += !sameOption(slice[i], optionSpecs[i + 2]);
+    }
+    errors += (size_t) &optionBatch.volatility[0] %
+              OPTION_BATCH_ALIGNMENT != 0;
+    errors += (size_t) &slice.strikePrice[0] % OPTION_BATCH_ALIGNMENT != 0;
+    std::cout << "[INFO] Option batch round trip" << std::endl;
+    check("Wrong options", errors, 0);
+}
+
+// Strikes share a cached lattice, the least recently used one is evicted,
+// and lattices still held outlive their eviction
+static void testLatticeCache() {
+    std::vector<OptionSpec> optionSpecs = testOptions(100);
+    LatticeCache latticeCache(2);
+    std::shared_ptr<const Lattice> first = latticeCache.get(optionSpecs[0]);
+    OptionSpec otherStrike = optionSpecs[0];
+    otherStrike.strikePrice += 10;
+    otherStrike.type = -otherStrike.type;
+    int errors = latticeCache.get(otherStrike) != first;
+
+    std::shared_ptr<const Lattice> second = latticeCache.get(optionSpecs[1]);
+    latticeCache.get(optionSpecs[0]);
+    latticeCache.get(optionSpecs[2]);
+    errors += latticeCache.get(optionSpecs[0]) != first;
+    errors += latticeCache.get(optionSpecs[1]) == second;
+
+    latticeCache.get(optionSpecs[2]);
+    std::shared_ptr<const Lattice> derived = latticeCache.get(optionSpecs[0]);
+    errors += derived == first;
+    errors += first->terminalPrices != derived->terminalPrices;
+    std::cout << "[INFO] Lattice cache hits and evictions" << std::endl;
+    check("Wrong lattices", errors, 0);
+}
+
+// Largest difference between prices of asynchronous calls, several of them
+// in flight at once, and the synchronous ones
+static double asyncError(OptionPricer* pricer,
+                         std::vector<OptionSpec>& optionSpecs) {
+    std::vector<std::future<double> > futures;
+    for (size_t i = 0; i < optionSpecs.size(); i ++) {
+        futures.push_back(pricer->priceAsync(optionSpecs[i]));
+    }
+    std::future<std::vector<double> > batchFuture =
+        pricer->priceAsync(optionSpecs);
+    std::vector<double> prices;
+    pricer->price(optionSpecs, prices);
+    std::vector<double> asyncPrices = batchFuture.get();
+    double error = 0;
+    for (size_t i = 0; i < optionSpecs.size(); i ++) {
+        error = std::max(error, std::fabs(asyncPrices[i] - prices[i]));
+        error = std::max(error, std::fabs(futures[i].get() -
+                                          pricer->price(optionSpecs[i])));
+    }
+    return error;
+}
+
+// Largest difference between a strike ladder of an American put priced by
+// pricer and its strikes priced one at a time by referencePricer
+static double ladderError(OptionPricer* pricer, OptionPricer* referencePricer,
+                          int numSteps) {
+    OptionSpec optionSpec = {-1, 100, 100, 1.0, 0.3, 0.02, numSteps, true};
+    std::vector<float> strikePrices;
+    for (int i = 0; i < 21; i ++) {
+        strikePrices.push_back(80.0f + 2 * i);
+    }
+    std::vector<double> prices;
+    pricer->priceLadder(optionSpec, strikePrices, prices);
+    double error = 0;
+    for (size_t i = 0; i < strikePrices.size(); i ++) {
+        optionSpec.strikePrice = strikePrices[i];
+        error = std::max(error, std::fabs(prices[i] -
+                                          referencePricer->price(optionSpec)));
+    }
+    return error;
+}
+
+// Black-Scholes delta and gamma of a European option
+static void blackScholesDeltaGamma(const OptionSpec& optionSpec,
+                                   double* delta, double* gamma) {
+    double stockPrice = optionSpec.stockPrice;
+    double volatilityRoot = optionSpec.volatility *
+                            sqrt(optionSpec.yearsToMaturity);
+    double d1 = (log(stockPrice / optionSpec.strikePrice) +
+                 (optionSpec.riskFreeRate + 0.5 * optionSpec.volatility *
+                  optionSpec.volatility) * optionSpec.yearsToMaturity) /
+                volatilityRoot;
+    *delta = 0.5 * erfc(-d1 / sqrt(2.0)) - (optionSpec.type == 1 ? 0 : 1);
+    *gamma = exp(-0.5 * d1 * d1) / sqrt(2 * M_PI) /
+             (stockPrice * volatilityRoot);
+}
+
+// Largest error of delta and gamma read off the lattices of pricer against
+// Black-Scholes, over the European options of testOptions
+static double greeksError(OptionPricer* pricer, int numSteps) {
+    std::vector<OptionSpec> optionSpecs = testOptions(numSteps);
+    double error = 0;
+    for (size_t i = 0; i < optionSpecs.size(); i ++) {
+        optionSpecs[i].isAmerican = false;
+        OptionGreeks greeks = pricer->priceWithGreeks(optionSpecs[i]);
+        double delta, gamma;
+        blackScholesDeltaGamma(optionSpecs[i], &delta, &gamma);
+        error = std::max(error, std::fabs(greeks.delta - delta));
+        error = std::max(error, std::fabs(greeks.gamma - gamma));
+    }
+    return error;
+}
+
+// Largest error of the volatilities pricer recovers from its own prices of
+// options of known volatilities, searched from a volatility of 0.5
+static double impliedVolatilityError(OptionPricer* pricer) {
+    std::vector<OptionSpec> optionSpecs = testOptions(200);
+    for (size_t i = 0; i < optionSpecs.size(); i ++) {
+        optionSpecs[i].volatility = 0.15f + 0.05f * i;
+    }
+    OptionBatch optionBatch(optionSpecs);
+    std::vector<double> marketPrices, volatilities;
+    pricer->price(optionBatch, marketPrices);
+    for (size_t i = 0; i < optionSpecs.size(); i ++) {
+        optionSpecs[i].volatility = 0.5f;
+    }
+    pricer->impliedVolatility(OptionBatch(optionSpecs), marketPrices,
+                              volatilities);
+    double error = 0;
+    for (size_t i = 0; i < optionSpecs.size(); i ++) {
+        error = std::max(error, std::fabs(volatilities[i] -
+                                          optionBatch.volatility[i]));
+    }
+    return error;
+}
+
+// Batches price every option as if it was priced on its own
+static void testBatchMatchesSingle() {
+    std::vector<OptionSpec> optionSpecs = testOptions(300);
+    SerialPricer serialPricer;
+    ParallelPricer parallelPricer(4, 16);
+    std::cout << "[INFO] Serial batch against single options" << std::endl;
+    check("Max error", batchError(&serialPricer, optionSpecs), 1e-12);
+    std::cout << "[INFO] Parallel batch against single options" << std::endl;
+    check("Max error", batchError(&parallelPricer, optionSpecs), 1e-12);
+    std::cout << "[INFO] Parallel async against sync" << std::endl;
+    check("Max error", asyncError(&parallelPricer, optionSpecs), 0);
+    std::cout << "[INFO] Parallel ladder against single strikes" << std::endl;
+    check("Max error", ladderError(&parallelPricer, &serialPricer, 1000),
+          1e-9);
+}
+
+static const char* MODEL_NAMES[] = {"CRR", "Jarrow-Rudd", "Tian",
+                                     "Leisen-Reimer", "Trinomial"};
+
+// ParallelPricer tiles the lattices SerialPricer walks in every model and
+// convergence mode, also with more tiles than threads and lattices that are
+// not a multiple of the tile, and reads the same greeks off them
+static void testParallelMatchesSerial() {
+    for (int model = 0; model < 5; model ++) {
+        double error = 0;
+        for (int mode = 0; mode < 3; mode ++) {
+            SerialPricer serialPricer;
+            ParallelPricer parallelPricer(4, 16);
+            serialPricer.setLatticeModel((LatticeModel) model);
+            parallelPricer.setLatticeModel((LatticeModel) model);
+            serialPricer.setConvergenceMode((ConvergenceMode) mode);
+            parallelPricer.setConvergenceMode((ConvergenceMode) mode);
+            for (int numSteps = 1; numSteps <= 1000;
+                 numSteps = 3 * numSteps + 2) {
+                std::vector<OptionSpec> optionSpecs = testOptions(numSteps);
+                for (size_t i = 0; i < optionSpecs.size(); i ++) {
+                    error = std::max(error,
+                            std::fabs(parallelPricer.price(optionSpecs[i]) -
+                                      serialPricer.price(optionSpecs[i])));
+                    OptionGreeks parallelGreeks =
+                        parallelPricer.priceWithGreeks(optionSpecs[i]);
+                    OptionGreeks serialGreeks =
+                        serialPricer.priceWithGreeks(optionSpecs[i]);
+                    error = std::max(error, std::fabs(parallelGreeks.delta -
+                                                      serialGreeks.delta));
+                    error = std::max(error, std::fabs(parallelGreeks.gamma -
+                                                      serialGreeks.gamma));
+                }
+                OptionBatch optionBatch(optionSpecs);
+                std::vector<double> parallelPrices, serialPrices;
+                parallelPricer.price(optionBatch, parallelPrices);
+                serialPricer.price(optionBatch, serialPrices);
+                for (size_t i = 0; i < optionSpecs.size(); i ++) {
+                    error = std::max(error, std::fabs(parallelPrices[i] -
+                                                      serialPrices[i]));
+                }
+            }
+        }
+        std::cout   << "[INFO] Parallel against serial, " << MODEL_NAMES[model]
+                    << std::endl;
+        check("Max error", error, 1e-9);
+    }
+}
+
+// Largest error against Black-Scholes of the European options of
+// testOptions on the lattices of pricer
+static double europeanError(LatticePricer* pricer, int numSteps) {
+    std::vector<OptionSpec> optionSpecs = testOptions(numSteps);
+    double error = 0;
+    for (size_t i = 0; i < optionSpecs.size(); i ++) {
+        optionSpecs[i].isAmerican = false;
+        error = std::max(error, std::fabs(pricer->price(optionSpecs[i]) -
+                                          blackScholesPrice(optionSpecs[i])));
+    }
+    return error;
+}
+
+// Every model converges to Black-Scholes, Leisen-Reimer at O(1/N^2) also
+// at even numSteps, and smoothing and extrapolation beat the plain lattice
+// by an order of magnitude
+static void testConvergence() {
+    SerialPricer pricer;
+    for (int model = 0; model < 5; model ++) {
+        pricer.setLatticeModel((LatticeModel) model);
+        std::cout   << "[INFO] European against Black-Scholes, "
+                    << MODEL_NAMES[model] << std::endl;
+        check("Max error", europeanError(&pricer, 1000), 5e-3);
+    }
+
+    pricer.setLatticeModel(LATTICE_LEISEN_REIMER);
+    for (int mode = 0; mode < 3; mode ++) {
+        pricer.setConvergenceMode((ConvergenceMode) mode);
+        std::cout   << "[INFO] Leisen-Reimer at 100 time-steps, mode "
+                    << mode << std::endl;
+        check("Max error", europeanError(&pricer, 100), 1e-3);
+    }
+    pricer.setConvergenceMode(CONVERGENCE_PLAIN);
+
+    pricer.setLatticeModel(LATTICE_CRR);
+    double plainError = europeanError(&pricer, 500);
+    pricer.setConvergenceMode(CONVERGENCE_BBSR);
+    double extrapolatedError = europeanError(&pricer, 500);
+    std::cout   << "[INFO] BBSR against plain CRR, plain error: "
+                << plainError << std::endl;
+    check("BBSR error", extrapolatedError, plainError / 10);
+}
+
+// Every instruction set the CPU supports computes the scalar results, also
+// over the tails of lattices that do not fill a vector
+static void testSimdMatchesScalar() {
+    SimdLevel bestLevel = detectSimdLevel();
+    for (int level = SIMD_SCALAR + 1; level <= bestLevel; level ++) {
+        double error = 0;
+        for (int numNodes = 1; numNodes <= 67; numNodes ++) {
+            std::vector<double> values(numNodes + 1), nodePrice(numNodes);
+            for (int j = 0; j <= numNodes; j ++) {
+                values[j] = 10 + 5 * sin(0.7 * j + numNodes);
+            }
+            for (int j = 0; j < numNodes; j ++) {
+                nodePrice[j] = 90 + 0.5 * j;
+            }
+            std::vector<double> scalarValues(values);
+
+            setSimdLevel(SIMD_SCALAR);
+            backwardInduction(&scalarValues[0], numNodes, 0.51, 0.48);
+            exerciseValue(&scalarValues[0], &nodePrice[0], numNodes, -1, 100);
+            setSimdLevel((SimdLevel) level);
+            backwardInduction(&values[0], numNodes, 0.51, 0.48);
+            exerciseValue(&values[0], &nodePrice[0], numNodes, -1, 100);
+            for (int j = 0; j < numNodes; j ++) {
+                error = std::max(error, std::fabs(values[j] -
+                                                  scalarValues[j]));
+            }
+        }
+        std::cout   << "[INFO] SIMD level " << level << " against scalar"
+                    << std::endl;
+        check("Max error", error, 1e-12);
+    }
+    setSimdLevel(bestLevel);
+}
+
+// Deep in and out of the money options, short and long dated, with and
+// without dividends, over several blocks of the batch formula and a tail
+static std::vector<OptionSpec> blackScholesOptions() {
+    std::vector<OptionSpec> optionSpecs = dividendOptions(100);
+    for (int i = 0; i < 601; i ++) {
+        OptionSpec optionSpec(i % 2 ? 1 : -1, 100, 40 + 0.35f * i,
+                              0.02f + 0.01f * (i % 500), 0.05f + 0.1f * (i % 8),
+                              0.01f * (i % 11), 100, false,
+                              0.005f * (i % 7));
+        if (i % 5 == 0) {
+            optionSpec.addDividend(0.01f, 1.0f);
+            optionSpec.addDividend(0.5f * optionSpec.yearsToMaturity, 2.5f);
+            optionSpec.addDividend(2 * optionSpec.yearsToMaturity, 3.0f);
+        }
+        optionSpecs.push_back(optionSpec);
+    }
+    return optionSpecs;
+}
+
+// Closed form batches, also with dividends, on every instruction set the
+// CPU supports against the scalar formula, and greeks against the local one
+static void testBlackScholes() {
+    std::vector<OptionSpec> optionSpecs = blackScholesOptions();
+    OptionBatch optionBatch(optionSpecs);
+    std::vector<double> prices;
+    BlackScholesPricer blackScholesPricer;
+    SimdLevel bestLevel = detectSimdLevel();
+    double priceError = 0;
+    for (int level = SIMD_SCALAR; level <= bestLevel; level ++) {
+        setSimdLevel((SimdLevel) level);
+        blackScholesPricer.price(optionBatch, prices);
+        for (size_t i = 0; i < optionSpecs.size(); i ++) {
+            priceError = std::max(priceError, std::fabs(prices[i] -
+                    blackScholesPrice(optionSpecs[i])));
+        }
+    }
+    setSimdLevel(bestLevel);
+
+    optionSpecs = testOptions(100);
+    double greeksError = 0;
+    for (size_t i = 0; i < optionSpecs.size(); i ++) {
+        OptionGreeks greeks = blackScholesGreeks(optionSpecs[i]);
+        double delta, gamma;
+        blackScholesDeltaGamma(optionSpecs[i], &delta, &gamma);
+        greeksError = std::max(greeksError, std::fabs(greeks.delta - delta));
+        greeksError = std::max(greeksError, std::fabs(greeks.gamma - gamma));
+    }
+    std::cout << "[INFO] Black-Scholes batch against scalar" << std::endl;
+    check("Max error", priceError, 1e-12);
+    std::cout << "[INFO] Black-Scholes greeks" << std::endl;
+    check("Max error", greeksError, 1e-12);
+}
+
+// European options go to Black-Scholes and American ones to the lattice, in
+// the order of the batch, and validation reprices the European ones on the
+// lattice. Batches of European options take the vectorized formula, which
+// differs from the scalar one by rounding
+static void testRoutingPricer() {
+    std::vector<OptionSpec> optionSpecs = testOptions(300);
+    SerialPricer serialPricer;
+    RoutingPricer routingPricer(new SerialPricer());
+    routingPricer.setValidation(1000, 1);
+    std::vector<double> prices;
+    routingPricer.price(optionSpecs, prices);
+
+    double error = 0;
+    double validationError = 0;
+    for (size_t i = 0; i < optionSpecs.size(); i ++) {
+        double expected;
+        OptionGreeks expectedGreeks;
+        if (optionSpecs[i].isAmerican) {
+            expected = serialPricer.price(optionSpecs[i]);
+            expectedGreeks = serialPricer.priceWithGreeks(optionSpecs[i]);
+        } else {
+            expected = blackScholesPrice(optionSpecs[i]);
+            expectedGreeks = blackScholesGreeks(optionSpecs[i]);
+            OptionSpec latticeSpec = optionSpecs[i];
+            latticeSpec.numSteps = 1000;
+            validationError = std::max(validationError, std::fabs(
+                    serialPricer.price(latticeSpec) - expected));
+        }
+        error = std::max(error, std::fabs(prices[i] - expected));
+        error = std::max(error, std::fabs(
+                routingPricer.price(optionSpecs[i]) - expected));
+        error = std::max(error, std::fabs(
+                routingPricer.priceWithGreeks(optionSpecs[i]).delta -
+                expectedGreeks.delta));
+    }
+    std::cout << "[INFO] Routing pricer dispatch" << std::endl;
+    check("Max error", error, 1e-12);
+    std::cout << "[INFO] Routing pricer validation" << std::endl;
+    check("Max error", std::fabs(routingPricer.maxValidationError() -
+                                 validationError), 0);
+}
+
+// Greeks of a single lattice walk against Black-Scholes
+static void testGreeks() {
+    SerialPricer serialPricer;
+    std::cout << "[INFO] Serial greeks against Black-Scholes" << std::endl;
+    check("Max error", greeksError(&serialPricer, 1000), 1e-4);
+    ParallelPricer parallelPricer;
+    std::cout << "[INFO] Parallel greeks against Black-Scholes" << std::endl;
+    check("Max error", greeksError(&parallelPricer, 1000), 1e-4);
+}
+
+// Volatilities recovered from lattice prices of known volatilities
+static void testImpliedVolatility() {
+    SerialPricer serialPricer;
+    std::cout << "[INFO] Implied volatility round trip" << std::endl;
+    check("Max error", impliedVolatilityError(&serialPricer), 1e-4);
+}
+
+// European options with a dividend yield and cash dividends, one of them
+// after maturity, against Black-Scholes on the escrowed stock price
+static void testDividends() {
+    OptionSpec optionSpec(-1, 100, 105, 1.0, 0.3, 0.02, 1000, false, 0.01f);
+    optionSpec.addDividend(0.25f, 1.5f);
+    optionSpec.addDividend(0.75f, 2.0f);
+    optionSpec.addDividend(1.5f, 5.0f);
+
+    double escrow = 1.5 * exp(-0.02 * 0.25) + 2.0 * exp(-0.02 * 0.75);
+    std::cout << "[INFO] Dividend escrow at maturity" << std::endl;
+    check("Error", std::fabs(dividendEscrow(dividendsToMaturity(optionSpec),
+                                            0) - escrow), 1e-6);
+
+    SerialPricer serialPricer;
+    ParallelPricer parallelPricer;
+    serialPricer.setConvergenceMode(CONVERGENCE_BBSR);
+    parallelPricer.setConvergenceMode(CONVERGENCE_BBSR);
+    double error = 0;
+    for (int type = -1; type <= 1; type += 2) {
+        optionSpec.type = type;
+        double referencePrice = blackScholesPrice(optionSpec);
+        error = std::max(error, std::fabs(serialPricer.price(optionSpec) -
+                                          referencePrice));
+        error = std::max(error, std::fabs(parallelPricer.price(optionSpec) -
+                                          referencePrice));
+    }
+    std::cout << "[INFO] Dividends against Black-Scholes" << std::endl;
+    check("Max error", error, 5e-4);
+
+    std::vector<OptionSpec> optionSpecs = dividendOptions(300);
+    std::vector<double> prices;
+    parallelPricer.price(optionSpecs, prices);
+    error = 0;
+    for (size_t i = 0; i < optionSpecs.size(); i ++) {
+        error = std::max(error, std::fabs(prices[i] -
+                                          serialPricer.price(optionSpecs[i])));
+    }
+    std::cout << "[INFO] Parallel dividends against serial" << std::endl;
+    check("Max error", error, 1e-9);
+}
+
+// Node price generators against pow() at every node, relative to the price
+static void testNodePrices() {
+    double upFactor = exp(0.3 * sqrt(1.0 / 2000));
+    double downFactor = 1 / upFactor;
+    int step = 2000;
+    std::vector<double> nodePrice(step + 1), powers(step + 1);
+    nodePrices(&nodePrice[0], 100, upFactor, downFactor, step, 0, step + 1);
+    powerTable(&powers[0], upFactor, step);
+    double error = 0;
+    for (int j = 0; j <= step; j ++) {
+        double expected = 100 * pow(upFactor, j) * pow(downFactor, step - j);
+        error = std::max(error, std::fabs(nodePrice[j] / expected - 1));
+        error = std::max(error, std::fabs(powers[j] / pow(upFactor, j) - 1));
+    }
+    previousNodePrices(&nodePrice[0], step, downFactor);
+    for (int j = 0; j < step; j ++) {
+        double expected = 100 * pow(upFactor, j) *
+                          pow(downFactor, step - 1 - j);
+        error = std::max(error, std::fabs(nodePrice[j] / expected - 1));
+    }
+    std::cout << "[INFO] Node prices against pow()" << std::endl;
+    check("Max relative error", error, 1e-12);
+}
+
+// Backends are built by name, an unknown name gives NULL, and OpenCL on a
+// device that does not exist falls back to the parallel pricer
+static void testPricerFactory() {
+    PricerConfig config;
+    config.backend = "serial";
+    OptionPricer* serialPricer = createPricer(config);
+    config.backend = "parallel";
+    OptionPricer* parallelPricer = createPricer(config);
+    config.backend = "opencl";
+    config.device.deviceName = "No such device";
+    OptionPricer* fallbackPricer = createPricer(config);
+    config.backend = "gpu";
+    OptionPricer* unknownPricer = createPricer(config);
+
+    std::cout << "[INFO] Pricer factory dispatch" << std::endl;
+    check("Wrong serial backend",
+          dynamic_cast<SerialPricer*>(serialPricer) == NULL ? 1 : 0, 0);
+    check("Wrong parallel backend",
+          dynamic_cast<ParallelPricer*>(parallelPricer) == NULL ? 1 : 0, 0);
+    check("Wrong fallback backend",
+          dynamic_cast<ParallelPricer*>(fallbackPricer) == NULL ? 1 : 0, 0);
+    check("Unknown backend built", unknownPricer != NULL ? 1 : 0, 0);
+
+    config.backend = "blackscholes";
+    OptionPricer* blackScholesPricer = createPricer(config);
+    config.backend = "serial";
+    config.routeEuropean = true;
+    OptionPricer* routingPricer = createPricer(config);
+    check("Wrong Black-Scholes backend",
+          dynamic_cast<BlackScholesPricer*>(blackScholesPricer) == NULL, 0);
+    check("Wrong routing backend",
+          dynamic_cast<RoutingPricer*>(routingPricer) == NULL, 0);
+    delete serialPricer;
+    delete parallelPricer;
+    delete fallbackPricer;
+    delete blackScholesPricer;
+    delete routingPricer;
+}
+
+#ifndef PRICER_CPU_ONLY
+// OpenCL lattices against the serial ones, in the batch kernels below 500
+// time-steps and the triangle kernels above
+static void testOpenCLMatchesSerial() {
+    SerialPricer serialPricer;
+    Precision precisions[] = {PRECISION_SINGLE, PRECISION_DOUBLE};
+    double tolerances[] = {1e-2, 1e-8};
+    for (int k = 0; k < 2; k ++) {
+        OpenCLPricer openclPricer(precisions[k]);
+        if (!openclPricer.isAvailable()) {
+            std::cout << "[INFO] No OpenCL device, skipping" << std::endl;
+            return;
+        }
+        double error = 0;
+        int numSteps[] = {20, 300, 1000};
+        for (int n = 0; n < 3; n ++) {
+            std::vector<OptionSpec> optionSpecs = testOptions(numSteps[n]);
+            std::vector<double> prices;
+            openclPricer.price(optionSpecs, prices);
+            for (size_t i = 0; i < optionSpecs.size(); i ++) {
+                double serialPrice = serialPricer.price(optionSpecs[i]);
+                error = std::max(error, std::fabs(prices[i] - serialPrice));
+                error = std::max(error, std::fabs(
+                        openclPricer.price(optionSpecs[i]) - serialPrice));
+            }
+        }
+        std::cout   << "[INFO] OpenCL against serial, precision " << k
+                    << std::endl;
+        check("Max error", error, tolerances[k]);
+
+        std::vector<OptionSpec> optionSpecs = testOptions(300);
+        std::cout   << "[INFO] OpenCL async against sync, precision " << k
+                    << std::endl;
+        check("Max error", asyncError(&openclPricer, optionSpecs), 0);
+    }
+}
+
+// Every algorithm for lattices too large for a work group against the serial
+// lattices, in double precision and at numSteps no stepSize divides
+static void testOpenCLAlgorithms() {
+    OpenCLPricer openclPricer(PRECISION_DOUBLE);
+    if (!openclPricer.isAvailable()) {
+        std::cout << "[INFO] No OpenCL device, skipping" << std::endl;
+        return;
+    }
+    const char* names[] = {"group", "triangle", "trapezoid"};
+    int stepSizes[] = {4, 125, 64};
+    SerialPricer serialPricer;
+    for (int algorithm = 0; algorithm < 3; algorithm ++) {
+        openclPricer.setAlgorithm((LatticeAlgorithm) algorithm,
+                                  stepSizes[algorithm]);
+        std::vector<OptionSpec> optionSpecs = testOptions(1000);
+        double error = 0;
+        for (size_t i = 0; i < optionSpecs.size(); i ++) {
+            error = std::max(error, std::fabs(
+                    openclPricer.price(optionSpecs[i]) -
+                    serialPricer.price(optionSpecs[i])));
+        }
+        std::cout   << "[INFO] OpenCL " << names[algorithm]
+                    << " against serial" << std::endl;
+        check("Max error", error, 1e-8);
+    }
+    std::cout << "[INFO] OpenCL ladder against single strikes" << std::endl;
+    check("Max error", ladderError(&openclPricer, &serialPricer, 1000), 1e-8);
+    std::cout << "[INFO] OpenCL greeks against Black-Scholes" << std::endl;
+    check("Max error", greeksError(&openclPricer, 1000), 1e-4);
+    std::cout << "[INFO] OpenCL implied volatility round trip" << std::endl;
+    check("Max error", impliedVolatilityError(&openclPricer), 1e-4);
+}
+
+// Entries are found by power of two bucket and device key, and are read back
+// from the file by a new table
+static void testTuningTable() {
+    char path[] = "/tmp/pricer_test_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        check("Tuning table file", 1, 0);
+        return;
+    }
+    close(fd);
+
+    int errors = 0;
+    errors += TuningTable::bucket(1) != 1;
+    errors += TuningTable::bucket(1000) != 512;
+    errors += TuningTable::bucket(1024) != 1024;
+
+    TuningEntry entry = {ALGORITHM_TRAPEZOID, 64, 1.5};
+    TuningTable(path).record("device", 600, entry);
+    TuningTable table(path);
+    TuningEntry found;
+    errors += !table.lookup("device", 1000, &found);
+    errors += found.algorithm != ALGORITHM_TRAPEZOID || found.stepSize != 64;
+    errors += table.lookup("device", 1024, &found);
+    errors += table.lookup("other device", 600, &found);
+    remove(path);
+
+    std::cout << "[INFO] Tuning table lookup" << std::endl;
+    check("Wrong lookups", errors, 0);
+}
+
+// OpenCL lattices of every model and convergence mode against the serial
+// ones, for single options and batches in double precision
+static void testOpenCLModes() {
+    OpenCLPricer openclPricer(PRECISION_DOUBLE);
+    if (!openclPricer.isAvailable()) {
+        std::cout << "[INFO] No OpenCL device, skipping" << std::endl;
+        return;
+    }
+    SerialPricer serialPricer;
+    for (int model = 0; model < 5; model ++) {
+        openclPricer.setLatticeModel((LatticeModel) model);
+        serialPricer.setLatticeModel((LatticeModel) model);
+        double error = 0;
+        for (int mode = 0; mode < 3; mode ++) {
+            openclPricer.setConvergenceMode((ConvergenceMode) mode);
+            serialPricer.setConvergenceMode((ConvergenceMode) mode);
+            for (int numSteps = 300; numSteps <= 1000; numSteps += 700) {
+                std::vector<OptionSpec> optionSpecs = testOptions(numSteps);
+                std::vector<double> prices;
+                openclPricer.price(optionSpecs, prices);
+                for (size_t i = 0; i < optionSpecs.size(); i ++) {
+                    double serialPrice = serialPricer.price(optionSpecs[i]);
+                    error = std::max(error, std::fabs(prices[i] -
+                                                      serialPrice));
+                    error = std::max(error, std::fabs(
+                            openclPricer.price(optionSpecs[i]) -
+                            serialPrice));
+                }
+            }
+        }
+        std::cout   << "[INFO] OpenCL against serial, " << MODEL_NAMES[model]
+                    << std::endl;
+        check("Max error", error, 1e-8);
+    }
+}
+
+// OpenCL lattices of options with dividends against the serial ones, in the
+// batch and single option kernels in double precision
+static void testOpenCLDividends() {
+    OpenCLPricer openclPricer(PRECISION_DOUBLE);
+    if (!openclPricer.isAvailable()) {
+        std::cout << "[INFO] No OpenCL device, skipping" << std::endl;
+        return;
+    }
+    SerialPricer serialPricer;
+    double error = 0;
+    for (int numSteps = 300; numSteps <= 1000; numSteps += 700) {
+        std::vector<OptionSpec> optionSpecs = dividendOptions(numSteps);
+        std::vector<double> prices;
+        openclPricer.price(optionSpecs, prices);
+        for (size_t i = 0; i < optionSpecs.size(); i ++) {
+            double serialPrice = serialPricer.price(optionSpecs[i]);
+            error = std::max(error, std::fabs(prices[i] - serialPrice));
+            error = std::max(error, std::fabs(
+                    openclPricer.price(optionSpecs[i]) - serialPrice));
+        }
+    }
+    std::cout << "[INFO] OpenCL dividends against serial" << std::endl;
+    check("Max error", error, 1e-8);
+}
+
+// Number of entries of directory besides . and .., deleting them when remove
+static int numEntries(const char* directory, bool remove) {
+    DIR* dir = opendir(directory);
+    if (dir == NULL) {
+        return 0;
+    }
+    int count = 0;
+    for (dirent* entry = readdir(dir); entry != NULL; entry = readdir(dir)) {
+        if (entry->d_name[0] != '.') {
+            count ++;
+            if (remove) {
+                unlink((std::string(directory) + "/" + entry->d_name).c_str());
+            }
+        }
+    }
+    closedir(dir);
+    return count;
+}
+
+// The first pricer stores its program binary, the second loads it and
+// prices the same
+static void testKernelCache() {
+    if (!OpenCLPricer().isAvailable()) {
+        std::cout << "[INFO] No OpenCL device, skipping" << std::endl;
+        return;
+    }
+    char directory[] = "/tmp/pricer_test_XXXXXX";
+    if (mkdtemp(directory) == NULL) {
+        check("Kernel cache directory", 1, 0);
+        return;
+    }
+    setenv("PRICER_KERNEL_CACHE", directory, 1);
+    OptionSpec optionSpec = {-1, 100, 100, 1.0, 0.3, 0.02, 1000, true};
+    double firstPrice = OpenCLPricer().price(optionSpec);
+    int numCached = numEntries(directory, false);
+    double cachedPrice = OpenCLPricer().price(optionSpec);
+    unsetenv("PRICER_KERNEL_CACHE");
+    numEntries(directory, true);
+    rmdir(directory);
+
+    std::cout   << "[INFO] Kernel binaries cached: " << numCached
+                << std::endl;
+    check("Missing binaries", numCached > 0 ? 0 : 1, 0);
+    check("Cached kernel error", std::fabs(cachedPrice - firstPrice), 0);
+}
+#endif
+
+int main() {
+    testOptionSpec();
+    testOptionBatch();
+    testLatticeCache();
+    testBatchMatchesSingle();
+    testParallelMatchesSerial();
+    testSimdMatchesScalar();
+    testNodePrices();
+    testBlackScholes();
+    testRoutingPricer();
+    testGreeks();
+    testConvergence();
+    testDividends();
+    testImpliedVolatility();
+    testPricerFactory();
+#ifndef PRICER_CPU_ONLY
+    testOpenCLMatchesSerial();
+    testOpenCLAlgorithms();
+    testOpenCLModes();
+    testOpenCLDividends();
+    testTuningTable();
+    testKernelCache();
+#endif
+
+    if (numFailures > 0) {
+        std::cerr << "[ERROR] " << numFailures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "[INFO] All checks passed" << std::endl;
+    return 0;
+}